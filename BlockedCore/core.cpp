@@ -0,0 +1,483 @@
+#include "core.h"
+#include <algorithm>
+#include <new>
+#include <type_traits>
+
+static const int dirX[4] = { 0, 0, -1, 1 };
+static const int dirY[4] = { -1, 1, 0, 0 };
+
+static int Dir(int x, int y) {
+	if (y)
+		return y < 0 ? 0 : 1;
+	return x < 0 ? 2 : 3;
+}
+
+// Which directions each tile can be walked into and out of, a bit per Dir.
+// Half walls only block across the side they're on.
+struct Passes {
+	uint8_t enter;
+	uint8_t exit;
+};
+
+static constexpr Passes passes[T_COUNT] = {
+	{ 0b1111, 0b1111 }, // T_AIR
+	{ 0b0000, 0b1111 }, // T_SOLID
+	{ 0b1111, 0b1111 }, // T_GOALA
+	{ 0b1111, 0b1111 }, // T_GOALB
+	{ 0b1110, 0b1101 }, // T_SOLIDBOTTOM: not in going up, not out going down
+	{ 0b1101, 0b1110 }, // T_SOLIDTOP: not in going down, not out going up
+	{ 0b1111, 0b1111 }, // T_FIRE
+};
+
+// canMove[from][to][dir], so a step is one lookup whatever tiles there are.
+struct MoveTable {
+	bool t[T_COUNT][T_COUNT][4];
+};
+
+static constexpr MoveTable BuildMoves() {
+	MoveTable m{};
+	for (int f = 0; f < T_COUNT; f++)
+		for (int t = 0; t < T_COUNT; t++)
+			for (int d = 0; d < 4; d++)
+				m.t[f][t][d] = (passes[f].exit >> d & 1) && (passes[t].enter >> d & 1);
+	return m;
+}
+
+static constexpr MoveTable canMove = BuildMoves();
+
+static Snapshot Snap(const Sim &s) {
+	Snapshot k(s.m.u.k.get_allocator()); // built in the arena, so moving it in doesn't copy
+	k.move = s.m.M;
+	k.p.reserve(2 + s.m.b.size());
+	k.p.push_back(s.a.y * s.m.w + s.a.x);
+	k.p.push_back(s.b.y * s.m.w + s.b.x);
+	for (const Box &b : s.m.b)
+		k.p.push_back(b.y * s.m.w + b.x);
+	return k;
+}
+
+static unsigned Get(const uint8_t *&p) {
+	unsigned v = 0;
+	int shift = 0;
+	uint8_t c;
+	do {
+		c = *p++;
+		v |= (c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return v;
+}
+
+// Get, for bytes that haven't been checked yet.
+static bool /* ok */ Get(const uint8_t *&p, const uint8_t *e, uint64_t &v) {
+	v = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (p == e)
+			return false;
+		uint8_t c = *p++;
+		v |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return v <= UINT32_MAX;
+	}
+	return false;
+}
+
+bool /* ok */ CheckLevel(const uint8_t *l, size_t size, const char **why) {
+	const uint8_t *p = l;
+	const uint8_t *e = l + size;
+	auto fail = [&](const char *what) {
+		if (why)
+			*why = what;
+		return false;
+	};
+	uint64_t w, h, v;
+	if (!Get(p, e, w) || !Get(p, e, h))
+		return fail("cut off in the size");
+	if (w < 1 || h < 1 || w > 0xffff || h > 0xffff)
+		return fail("size out of range");
+	uint64_t n = w * h;
+	if (n > (uint64_t)levelMaxArea)
+		return fail("map too big");
+	if ((n + 1) / 2 > (uint64_t)(e - p))
+		return fail("cut off in the tiles");
+	for (uint64_t i = 0; i < n; i++)
+		if ((i & 1 ? p[i / 2] >> 4 : p[i / 2] & 15) >= T_COUNT)
+			return fail("unknown tile");
+	p += (n + 1) / 2;
+
+	for (int i = 0; i < 2; i++)
+		if (!Get(p, e, v) || v >= n)
+			return fail("a player is off the map");
+	uint64_t boxes, buttons, doors;
+	if (!Get(p, e, boxes))
+		return fail("cut off in the boxes");
+	for (uint64_t i = 0; i < boxes; i++)
+		if (!Get(p, e, v) || v >= n)
+			return fail("a box is off the map");
+	if (!Get(p, e, buttons))
+		return fail("cut off in the buttons");
+	for (uint64_t i = 0; i < buttons; i++)
+		if (!Get(p, e, v) || v >= n)
+			return fail("a button is off the map");
+	if (!Get(p, e, doors))
+		return fail("cut off in the doors");
+	for (uint64_t i = 0; i < doors; i++) {
+		if (!Get(p, e, v) || v >= n)
+			return fail("a door is off the map");
+		if (!Get(p, e, v) || v >= buttons)
+			return fail("door linked to a button that isn't there");
+	}
+	if (!Get(p, e, v) || v != (uint64_t)(e - p))
+		return fail("the name doesn't run to the end");
+	return true;
+}
+
+bool /* ok */ LoadMap(Sim &s, const uint8_t *l, size_t size, const char **why) {
+	if (!CheckLevel(l, size, why))
+		return false;
+	LoadMap(s, l);
+	return true;
+}
+
+bool /* ok */ LoadMap(Sim &s, const char *m /* map to load */, const char **why) {
+	Level l;
+	if (!CompileMap(m, l, why))
+		return false;
+	LoadMap(s, l.data());
+	return true;
+}
+
+// Everything the old map had goes back to its arena, the arena goes back to
+// its first block, and the new map starts carving from the top again.
+static void ResetMap(Map &m) {
+	size_t cap = m.u.cap;
+	int every = m.u.every;
+	bool watch = m.watch;
+	m.~Map();
+	new (&m) Map;
+	m.u.cap = cap;
+	m.u.every = every;
+	m.watch = watch;
+}
+
+void LoadMap(Sim &s, const uint8_t *l /* map to load */) {
+	const uint8_t *p = l;
+	ResetMap(s.m);
+	s.m.w = Get(p);
+	s.m.h = Get(p);
+	int n = s.m.w * s.m.h;
+	s.m.m.resize(n);
+	for (int i = 0; i < n; i += 2, p++) {
+		s.m.m[i] = (Tile)(*p & 15);
+		if (i + 1 < n)
+			s.m.m[i + 1] = (Tile)(*p >> 4);
+	}
+
+	int a = Get(p);
+	int b = Get(p);
+	s.a = Player{ .x = a % s.m.w, .y = a / s.m.w, .lx = a % s.m.w, .ly = a / s.m.w, .w = false };
+	s.b = Player{ .x = b % s.m.w, .y = b / s.m.w, .lx = b % s.m.w, .ly = b / s.m.w, .w = false };
+	s.m.b.resize(Get(p));
+	for (size_t i = 0; i < s.m.b.size(); i++) {
+		int t = Get(p);
+		s.m.b[i] = Box{ .x = t % s.m.w, .y = t / s.m.w, .lx = t % s.m.w, .ly = t / s.m.w, .id = (int)i, .at = -1 };
+	}
+	s.m.B.resize(Get(p));
+	for (Button &B : s.m.B) {
+		int t = Get(p);
+		B = Button{ .x = t % s.m.w, .y = t / s.m.w };
+	}
+	s.m.d.resize(Get(p));
+	for (Door &d : s.m.d) {
+		int t = Get(p);
+		d = Door{ .x = t % s.m.w, .y = t / s.m.w, .bRef = (int)Get(p) };
+	}
+	size_t len = Get(p);
+	s.m.n.assign((const char *)p, len);
+	s.m.M = 0;
+
+	for (Bits *b : { &s.m.fire, &s.m.goalA, &s.m.goalB })
+		b->Resize(n);
+	s.m.boxAt.assign(n, -1);
+	s.m.buttonAt.assign(n, -1);
+	s.m.doorAt.assign(n, -1);
+	for (int i = 0; i < n; i++) {
+		switch (s.m.m[i]) {
+		case T_FIRE:
+			s.m.fire.Set(i);
+			break;
+		case T_GOALA:
+			s.m.goalA.Set(i);
+			break;
+		case T_GOALB:
+			s.m.goalB.Set(i);
+			break;
+		default:
+			break;
+		}
+	}
+	for (size_t i = 0; i < s.m.B.size(); i++)
+		s.m.buttonAt[s.m.B[i].y * s.m.w + s.m.B[i].x] = (int)i;
+	for (size_t i = 0; i < s.m.d.size(); i++)
+		s.m.doorAt[s.m.d[i].y * s.m.w + s.m.d[i].x] = (int)i;
+
+	// Counting sort of the doors by button.
+	for (const Door &d : s.m.d)
+		s.m.B[d.bRef].to++;
+	int at = 0;
+	for (Button &B : s.m.B) {
+		B.from = at;
+		at += B.to;
+		B.to = B.from;
+	}
+	s.m.doorsOf.resize(s.m.d.size());
+	for (size_t i = 0; i < s.m.d.size(); i++)
+		s.m.doorsOf[s.m.B[s.m.d[i].bRef].to++] = (int)i;
+
+	PlaceBoxes(s);
+	s.m.changes.clear(); // how it starts isn't a change
+	s.m.u.k.push_back(Snap(s));
+}
+
+static void SetDoor(Sim &s, int i, bool open) {
+	Door &d = s.m.d[i];
+	if (d.open == open)
+		return;
+	d.open = open;
+	if (s.m.watch)
+		s.m.changes.push_back(DoorChange{ .door = i, .open = open });
+}
+
+static void PressButton(Sim &s, int i, bool down) {
+	Button &B = s.m.B[i];
+	if (B.down == down)
+		return;
+	B.down = down;
+	for (int j = B.from; j < B.to; j++)
+		SetDoor(s, s.m.doorsOf[j], down);
+}
+
+// Only touches the cells the boxes were filed under and are now on, so it's
+// as cheap on a huge map as on a small one.
+void PlaceBoxes(Sim &s) {
+	for (Box &b : s.m.b)
+		if (b.at >= 0 && s.m.boxAt[b.at] == b.id)
+			s.m.boxAt[b.at] = -1;
+	for (Box &b : s.m.b) {
+		b.at = b.y * s.m.w + b.x;
+		s.m.boxAt[b.at] = b.id;
+	}
+	for (size_t i = 0; i < s.m.B.size(); i++)
+		PressButton(s, (int)i, s.m.boxAt[s.m.B[i].y * s.m.w + s.m.B[i].x] >= 0);
+}
+
+static void MoveBox(Sim &s, Box &b, int x, int y) {
+	int from = b.at;
+	if (s.m.boxAt[from] == b.id)
+		s.m.boxAt[from] = -1;
+	b.x = x;
+	b.y = y;
+	b.at = b.y * s.m.w + b.x;
+	s.m.boxAt[b.at] = b.id;
+
+	if (s.m.buttonAt[from] >= 0 && s.m.boxAt[from] < 0)
+		PressButton(s, s.m.buttonAt[from], false);
+	if (s.m.buttonAt[b.at] >= 0)
+		PressButton(s, s.m.buttonAt[b.at], true);
+}
+
+// Where move `m` ends in the turn bytes, counting from the very first byte.
+static uint64_t End(const History &u, int m) {
+	return m == u.base ? u.start : u.f[m - u.base - 1];
+}
+
+// What's held, not what it takes up in the arena.
+static size_t Bytes(const Sim &s) {
+	const History &u = s.m.u;
+	size_t snap = sizeof(Snapshot) + (2 + s.m.b.size()) * sizeof(int);
+	return u.d.size() + u.f.size() * sizeof(uint64_t) + u.k.size() * snap;
+}
+
+static void Record(Sim &s, int who, int x, int y) {
+	unsigned v = who << 2 | Dir(x, y);
+	while (v >= 0x80) {
+		s.m.u.d.push_back((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	s.m.u.d.push_back(v);
+}
+
+static void Trim(Sim &s) {
+	History &u = s.m.u;
+	while (Bytes(s) > u.cap && u.k.size() > 1) {
+		int to = u.k[1].move;
+		uint64_t end = End(u, to);
+		u.d.erase(u.d.begin(), u.d.begin() + (end - u.start));
+		u.f.erase(u.f.begin(), u.f.begin() + (to - u.base));
+		u.k.pop_front();
+		u.start = end;
+		u.base = to;
+	}
+}
+
+int /* moves undone */ Undo(Sim &s, int n) {
+	History &u = s.m.u;
+	int k = s.m.M - n; // moves left afterwards
+	if (k < u.base)
+		k = u.base;
+	int undone = s.m.M - k;
+	if (undone <= 0)
+		return 0;
+
+	// Turns are read back to front. Only the last byte of a varint has its
+	// top bit clear, so the bytes before it that have it set belong with it.
+	size_t from = End(u, k) - u.start;
+	size_t i = u.d.size();
+	while (i > from) {
+		unsigned v = u.d[--i];
+		while (i > from && (u.d[i - 1] & 0x80))
+			v = (v << 7) | (u.d[--i] & 0x7f);
+
+		int who = v >> 2;
+		int x = dirX[v & 3];
+		int y = dirY[v & 3];
+		if (who == 0) {
+			s.a.x = s.a.lx = s.a.x - x;
+			s.a.y = s.a.ly = s.a.y - y;
+		}
+		else if (who == 1) {
+			s.b.x = s.b.lx = s.b.x - x;
+			s.b.y = s.b.ly = s.b.y - y;
+		}
+		else {
+			Box &b = s.m.b[who - 2];
+			MoveBox(s, b, b.x - x, b.y - y);
+		}
+	}
+
+	u.d.resize(from);
+	u.f.resize(k - u.base);
+	while (!u.k.empty() && u.k.back().move > k)
+		u.k.pop_back();
+	s.m.M = k;
+	return undone;
+}
+
+bool /* held */ PositionAt(const Sim &s, int move, Snapshot &out) {
+	const History &u = s.m.u;
+	if (move < u.base || move > s.m.M || u.k.empty())
+		return false;
+
+	auto it = std::upper_bound(u.k.begin(), u.k.end(), move, [](int m, const Snapshot &k) { return m < k.move; });
+	out = *--it;
+
+	size_t i = End(u, out.move) - u.start;
+	size_t to = End(u, move) - u.start;
+	while (i < to) {
+		unsigned v = 0;
+		int shift = 0;
+		uint8_t c;
+		do {
+			c = u.d[i++];
+			v |= (c & 0x7f) << shift;
+			shift += 7;
+		} while (c & 0x80);
+		out.p[v >> 2] += dirY[v & 3] * s.m.w + dirX[v & 3];
+	}
+	out.move = move;
+	return true;
+}
+
+template <class T>
+static bool /* success */ TryMove(Sim &s, T &m, Player &o, int x, int y) {
+	//if (m.w)
+	//	return false;
+
+	m.lx = m.x;
+	m.ly = m.y;
+
+	if (m.x + x < 0 || m.y + y < 0)
+		return false;
+	if (m.x + x >= s.m.w || m.y + y >= s.m.h)
+		return false;
+
+	if (m.x + x == o.x && m.y + y == o.y)
+		return false;
+
+	int to = (m.y + y) * s.m.w + m.x + x;
+	int from = m.y * s.m.w + m.x;
+
+	if (!canMove.t[s.m.m[from]][s.m.m[to]][Dir(x, y)])
+		return false;
+
+	int d = s.m.doorAt[to];
+	if (d >= 0 && !s.m.d[d].open)
+		return false;
+
+	int b = s.m.boxAt[to];
+	if (b >= 0) {
+		if (!TryMove<Box>(s, s.m.b[b], o, x, y))
+			return false;
+		Record(s, 2 + b, x, y);
+	}
+
+	if constexpr (std::is_same_v<T, Box>) {
+		MoveBox(s, m, m.x + x, m.y + y);
+	}
+	else {
+		m.x += x;
+		m.y += y;
+	}
+	return true;
+}
+
+static bool /* success */ TryMovePlayer(Sim &s, Player &p, Player &o, int id, int x, int y) {
+	if (TryMove<Player>(s, p, o, x, y)) {
+		Record(s, id, x, y);
+		return true;
+	}
+	return false;
+}
+
+bool /* success */ TryMoveA(Sim &s, int x, int y) {
+	return TryMovePlayer(s, s.a, s.b, 0, x, y);
+}
+
+bool /* success */ TryMoveB(Sim &s, int x, int y) {
+	return TryMovePlayer(s, s.b, s.a, 1, x, y);
+}
+
+bool /* moved */ EnactMove(Sim &s, bool a, bool b) {
+	if (!a && !b)
+		return false;
+	History &u = s.m.u;
+	s.m.M++;
+	u.f.push_back(u.start + u.d.size());
+	if (s.m.M % u.every == 0)
+		u.k.push_back(Snap(s));
+	Trim(s);
+	return true;
+}
+
+bool /* moved */ Step(Sim &s, int x, int y) {
+	// Spelled out so A always goes first; argument order isn't.
+	bool a = TryMoveA(s, x, y);
+	bool b = TryMoveB(s, -x, -y);
+	return EnactMove(s, a, b);
+}
+
+bool AOverlaps(const Sim &s, Tile t) {
+	return s.m.m[s.a.y * s.m.w + s.a.x] == t;
+}
+
+bool BOverlaps(const Sim &s, Tile t) {
+	return s.m.m[s.b.y * s.m.w + s.b.x] == t;
+}
+
+bool Won(const Sim &s) {
+	return s.m.goalA.Get(s.a.y * s.m.w + s.a.x) && s.m.goalB.Get(s.b.y * s.m.w + s.b.x);
+}
+
+bool OnFire(const Sim &s) {
+	return s.m.fire.Get(s.a.y * s.m.w + s.a.x) || s.m.fire.Get(s.b.y * s.m.w + s.b.x);
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+// The puzzle rules, with no raylib in sight.
+// The game and the batch tools both step the same code through here.
+
+#include "level.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct Box {
+	int x;
+	int y;
+	int lx;
+	int ly;
+	int id;
+	int at = -1; // the cell boxAt has it under
+};
+
+struct Button {
+	int x;
+	int y;
+	bool down = false; // a box is on it
+	int from = 0; // its doors are doorsOf[from, to)
+	int to = 0;
+};
+
+struct Door {
+	int x;
+	int y;
+	int bRef;
+	bool open = false; // kept up to date as boxes come and go
+};
+
+// A door that just opened or shut.
+struct DoorChange {
+	int door;
+	bool open;
+};
+
+// Who was where, for seeking through the history without replaying it all.
+// It takes the allocator of whatever holds it, so the ones in History live
+// in the map's arena along with everything else.
+struct Snapshot {
+	using allocator_type = std::pmr::polymorphic_allocator<>;
+
+	int move = 0;
+	std::pmr::vector<int> p; // A, B, then each box, as tile indices
+
+	Snapshot() = default;
+	explicit Snapshot(const allocator_type &a) : p(a) {}
+	Snapshot(const Snapshot &o, const allocator_type &a) : move(o.move), p(o.p, a) {}
+	Snapshot(Snapshot &&o, const allocator_type &a) : move(o.move), p(std::move(o.p), a) {}
+	Snapshot(const Snapshot &) = default;
+	Snapshot(Snapshot &&) = default;
+	Snapshot &operator=(const Snapshot &) = default;
+	Snapshot &operator=(Snapshot &&) = default;
+};
+
+// Undo history. Each thing that moved is one varint turn, (who << 2 | dir),
+// where who is 0 for A, 1 for B and 2 + id for a box. There's a snapshot
+// every `every` moves, and once the turns, move ends and snapshots add up to
+// more than `cap` bytes the oldest moves up to the next snapshot are
+// forgotten. That's what's stored, not what it costs: deque blocks and the
+// arena's pools come on top, and with the default cap a long session
+// settles at about 2 MiB of arena.
+struct History {
+	size_t cap = 1 << 20; // bytes of turns, move ends and snapshots
+	int every = 64; // moves between snapshots
+	int base = 0; // oldest move that can be gone back to
+	uint64_t start = 0; // how many bytes have been dropped off the front of d
+	std::pmr::deque<uint8_t> d; // turns
+	std::pmr::deque<uint64_t> f; // where each move after base ends, counting from the very first byte
+	std::pmr::deque<Snapshot> k; // at base, then every `every` moves
+};
+
+// One bit per tile, row-major, so the hot checks are a shift and a mask.
+struct Bits {
+	std::pmr::vector<uint64_t> w;
+
+	void Resize(int n) {
+		w.assign((n + 63) / 64, 0);
+	}
+
+	bool Get(int i) const {
+		return (w[i >> 6] >> (i & 63)) & 1;
+	}
+
+	void Set(int i) {
+		w[i >> 6] |= 1ull << (i & 63);
+	}
+
+	void Clear(int i) {
+		w[i >> 6] &= ~(1ull << (i & 63));
+	}
+};
+
+// Where one map's data lives, so moving to the next map throws it all away
+// at once instead of freeing it piece by piece. Loading any of the built-in
+// maps fits in `first` without touching the heap, and so does play until
+// the undo history outgrows it; the pool hands back what the history trims.
+// The pool takes small chunks, or its first few would fill `first` alone.
+struct Arena {
+	std::byte first[16 << 10];
+	std::pmr::monotonic_buffer_resource block{ first, sizeof(first) };
+	std::pmr::unsynchronized_pool_resource pool{ std::pmr::pool_options{ .max_blocks_per_chunk = 8 }, &block };
+
+	Arena() = default;
+	Arena(const Arena &) : Arena() {} // a copy gets an arena of its own
+	Arena &operator=(const Arena &) { return *this; }
+};
+
+struct Map {
+	Arena a; // everything below is carved out of this
+	int M = 0; // moves;
+	int w;
+	int h;
+	std::pmr::string n{ &a.pool }; // name
+	std::pmr::vector<Tile> m{ &a.pool }; // map data, a byte a tile
+	std::pmr::vector<Box> b{ &a.pool }; // boxes
+	std::pmr::vector<Button> B{ &a.pool }; // buttons
+	std::pmr::vector<Door> d{ &a.pool }; // doors
+	History u{ .d = std::pmr::deque<uint8_t>(&a.pool), .f = std::pmr::deque<uint64_t>(&a.pool), .k = std::pmr::deque<Snapshot>(&a.pool) }; // undo history
+
+	Bits fire{ .w = std::pmr::vector<uint64_t>(&a.pool) };
+	Bits goalA{ .w = std::pmr::vector<uint64_t>(&a.pool) };
+	Bits goalB{ .w = std::pmr::vector<uint64_t>(&a.pool) };
+
+	// What's on each cell, by index into b, B and d, or -1 for nothing.
+	std::pmr::vector<int> boxAt{ &a.pool }; // kept in step with b, through moves and Undo
+	std::pmr::vector<int> buttonAt{ &a.pool };
+	std::pmr::vector<int> doorAt{ &a.pool };
+	std::pmr::vector<int> doorsOf{ &a.pool }; // door indices, grouped by button
+
+	bool watch = false; // keep changes for whoever's listening
+	std::pmr::vector<DoorChange> changes{ &a.pool }; // oldest first; the listener clears it
+
+	Map() = default;
+	// Copies land in the copy's own arena: assigning a pmr container keeps
+	// the allocator it already has.
+	Map(const Map &o) {
+		*this = o;
+	}
+	Map &operator=(const Map &) = default;
+};
+
+struct Player {
+	int x;
+	int y;
+	int lx;
+	int ly;
+	bool w; // won
+};
+
+struct Sim {
+	Map m;
+	Player a;
+	Player b;
+};
+
+extern const int mapCount;
+
+// The built-in maps, compiled while building (see maps.cpp).
+const uint8_t *MapLevel(int i);
+// Fewest moves for a built-in map, or -1 if it isn't known.
+int MapPar(int i);
+// Trusts l to be a whole, well-formed level, as the built-in ones are.
+void LoadMap(Sim &s, const uint8_t *l /* map to load */);
+// For levels read from outside: false, with why filled in, if the bytes
+// aren't a level.
+bool /* ok */ CheckLevel(const uint8_t *l, size_t size, const char **why = nullptr);
+bool /* ok */ LoadMap(Sim &s, const uint8_t *l, size_t size, const char **why = nullptr);
+// Compiles first; for maps that aren't built in.
+bool /* ok */ LoadMap(Sim &s, const char *m /* map to load */, const char **why = nullptr);
+bool /* success */ TryMoveA(Sim &s, int x, int y);
+bool /* success */ TryMoveB(Sim &s, int x, int y);
+// Closes the turns recorded since the last move into one move.
+bool /* moved */ EnactMove(Sim &s, bool a, bool b);
+// A moves by (x, y) and B mirrors it, same as the arrow keys.
+bool /* moved */ Step(Sim &s, int x, int y);
+int /* moves undone */ Undo(Sim &s, int n = 1);
+// Where everything stood after `move`, if the history still goes back that far.
+bool /* held */ PositionAt(const Sim &s, int move, Snapshot &out);
+bool AOverlaps(const Sim &s, Tile t);
+bool BOverlaps(const Sim &s, Tile t);
+bool Won(const Sim &s);
+bool OnFire(const Sim &s);
+// Rebuilds the box bits after boxes were moved by hand.
+void PlaceBoxes(Sim &s);
@@ -0,0 +1,195 @@
+#pragma once
+
+// A map compiled out of the string syntax in maps.cpp: varint width and
+// height, the tiles packed two to a byte, then varints for where A and B
+// start, the boxes, the buttons, each door and the button it hangs off,
+// and the name.
+//
+// It's all constexpr so the built-in maps compile while the game does, and
+// a broken one stops the build at the LevelFail naming what's wrong.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+typedef std::vector<uint8_t> Level;
+
+enum Tile : uint8_t {
+	T_AIR,
+	T_SOLID,
+	T_GOALA,
+	T_GOALB,
+	T_SOLIDBOTTOM,
+	T_SOLIDTOP,
+	T_FIRE,
+
+	T_COUNT
+};
+
+static_assert(T_COUNT <= 16, "tiles are packed two to a byte");
+
+constexpr bool LevelFail(const char *what, const char **why) {
+	if (std::is_constant_evaluated())
+		throw what; // a built-in map is broken; `what` says how
+	if (why)
+		*why = what;
+	return false;
+}
+
+constexpr void LevelPut(Level &l, unsigned v) {
+	while (v >= 0x80) {
+		l.push_back((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	l.push_back(v);
+}
+
+// Most tiles a map can have, so cell indices and w * h stay well inside an int.
+constexpr int64_t levelMaxArea = 1 << 24;
+
+// A decimal number, for the bits of the string syntax that can run past 9.
+// Nothing in a map goes past 0xffff, so anything bigger is refused.
+constexpr bool /* ok */ LevelNumber(const char *&m, int &out) {
+	if (*m < '0' || *m > '9')
+		return false;
+	out = 0;
+	while (*m >= '0' && *m <= '9') {
+		out = out * 10 + (*m++ - '0');
+		if (out > 0xffff)
+			return false;
+	}
+	return true;
+}
+
+// Width and height can be written "(12,40)" instead of two digits, and door
+// links "(10,2,...)" instead of a digit each, for maps past 9 of anything.
+constexpr bool /* ok */ CompileMap(const char *m /* map source */, Level &out, const char **why = nullptr) {
+	int w = 0;
+	int h = 0;
+	if (*m == '(') {
+		m++;
+		if (!LevelNumber(m, w) || *m++ != ',' || !LevelNumber(m, h) || *m++ != ')')
+			return LevelFail("size should read (w,h)", why);
+	}
+	else {
+		if (!m[0] || !m[1])
+			return LevelFail("map too short for its size", why);
+		w = (*m++) - '0';
+		h = (*m++) - '0';
+	}
+	if (w < 1 || h < 1 || w > 0xffff || h > 0xffff)
+		return LevelFail("size out of range", why);
+	if ((int64_t)w * h > levelMaxArea)
+		return LevelFail("map too big", why);
+
+	std::vector<uint8_t> t(w * h, T_AIR);
+	int a = -1;
+	int b = -1;
+	std::vector<int> boxes;
+	std::vector<int> buttons;
+	std::vector<int> doors;
+	int idx = 0;
+	while (idx < w * h && *m) {
+		switch (*m) {
+		case '|':
+			idx--;
+			break;
+		case 'a':
+			a = idx;
+			break;
+		case 'b':
+			b = idx;
+			break;
+		case ' ':
+			break;
+		case 'A':
+			t[idx] = T_GOALA;
+			break;
+		case 'B':
+			t[idx] = T_GOALB;
+			break;
+		case '*':
+			t[idx] = T_SOLID;
+			break;
+		case '.':
+			boxes.push_back(idx);
+			break;
+		case '_':
+			buttons.push_back(idx);
+			break;
+		case '&':
+			doors.push_back(idx);
+			break;
+		case 'v':
+			t[idx] = T_SOLIDBOTTOM;
+			break;
+		case '^':
+			t[idx] = T_SOLIDTOP;
+			break;
+		case '+':
+			idx -= 2;
+			break;
+		case '!':
+			t[idx] = T_FIRE;
+			break;
+		default:
+			return LevelFail("unknown tile character", why);
+		}
+		if (idx < -1)
+			return LevelFail("backed up off the start of the map", why);
+		m++;
+		idx++;
+	}
+	if (idx < w * h)
+		return LevelFail("fewer tiles than the size says", why);
+	if (a < 0 || b < 0)
+		return LevelFail("needs an a and a b", why);
+
+	// Which button opens each door: one digit apiece, or "(12,3,...)".
+	std::vector<int> refs;
+	if (!doors.empty() && *m == '(') {
+		m++;
+		for (size_t i = 0; i < doors.size(); i++) {
+			int r = 0;
+			if (!LevelNumber(m, r) || *m++ != (i + 1 < doors.size() ? ',' : ')'))
+				return LevelFail("door links don't match the number of doors", why);
+			refs.push_back(r);
+		}
+	}
+	else {
+		for (size_t i = 0; i < doors.size(); i++) {
+			if (*m < '0' || *m > '9')
+				return LevelFail("door links don't match the number of doors", why);
+			refs.push_back((*m++) - '0');
+		}
+	}
+	for (int r : refs)
+		if (r >= (int)buttons.size())
+			return LevelFail("door linked to a button that isn't there", why);
+
+	out.clear();
+	LevelPut(out, w);
+	LevelPut(out, h);
+	for (size_t i = 0; i < t.size(); i += 2)
+		out.push_back(t[i] | (i + 1 < t.size() ? t[i + 1] << 4 : 0));
+	LevelPut(out, a);
+	LevelPut(out, b);
+	LevelPut(out, (unsigned)boxes.size());
+	for (int i : boxes)
+		LevelPut(out, i);
+	LevelPut(out, (unsigned)buttons.size());
+	for (int i : buttons)
+		LevelPut(out, i);
+	LevelPut(out, (unsigned)doors.size());
+	for (size_t i = 0; i < doors.size(); i++) {
+		LevelPut(out, doors[i]);
+		LevelPut(out, refs[i]);
+	}
+	size_t n = std::char_traits<char>::length(m);
+	LevelPut(out, (unsigned)n);
+	for (size_t i = 0; i < n; i++)
+		out.push_back(m[i]);
+	return true;
+}
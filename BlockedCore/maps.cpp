@@ -0,0 +1,100 @@
+#include "core.h"
+#include <array>
+#include <iterator>
+
+static constexpr const char *sources[] = {
+	"44a  B"
+	"||    "
+	"||    "
+	"||A  b"
+	"Straight Across",
+
+	"84a       "
+	"||  B *   "
+	"||     A  "
+	"||       b"
+	"Flipped Flags",
+
+	"98a       B"
+	"||         "
+	"||      ***"
+	"||A*       "
+	"||   ***   "
+	"||   ***   "
+	"||   ***   "
+	"||   ***  b"
+	"Into the Ceiling",
+
+	"98a        "
+	"||      .  "
+	"||  _      "
+	"|| ******* "
+	"|| *B*   & "
+	"|| *A    & "
+	"|| ******* "
+	"||        b"
+	"00" // doors
+	"Button & Box",
+
+	"97a  &  v  " // d0
+	"|| _ &  _. " // b0 d1 b1
+	"||   &.b   " // d2
+	"||*&**    ^" // d3
+	"||A   *&***" // d4
+	"|| _.      " // b2
+	"||        B"
+	"11102" // doors
+	"Three Doors"
+};
+
+// Every map compiled back to back at build time, so a broken one is a build
+// error and loading one is just reading the bytes.
+
+static constexpr size_t Compiled(const char *m) {
+	Level l;
+	CompileMap(m, l);
+	return l.size();
+}
+
+static constexpr size_t Total() {
+	size_t n = 0;
+	for (const char *m : sources)
+		n += Compiled(m);
+	return n;
+}
+
+struct Baked {
+	std::array<uint8_t, Total()> d;
+	size_t at[std::size(sources)]; // where each map starts in d
+};
+
+static constexpr Baked Bake() {
+	Baked b{};
+	size_t n = 0;
+	for (size_t i = 0; i < std::size(sources); i++) {
+		Level l;
+		CompileMap(sources[i], l);
+		b.at[i] = n;
+		for (uint8_t c : l)
+			b.d[n++] = c;
+	}
+	return b;
+}
+
+static constexpr Baked baked = Bake();
+
+const int mapCount = (int)std::size(sources);
+
+const uint8_t *MapLevel(int i) {
+	return baked.d.data() + baked.at[i];
+}
+
+// In map order, from `blockedtool par`, which says when one's gone stale.
+// Searching for them at load time stalls the game on big maps.
+static constexpr int pars[] = { 3, 7, 14, 32, 33 };
+
+static_assert(std::size(pars) == std::size(sources), "one par per map; -1 if it isn't known");
+
+int MapPar(int i) {
+	return pars[i];
+}
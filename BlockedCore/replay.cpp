@@ -0,0 +1,125 @@
+#include "replay.h"
+#include <cstring>
+
+static const char magic[4] = { 'B', 'R', 'P', 'L' };
+static const uint8_t version = 1;
+
+static void Header(Replay &r) {
+	if (r.e.empty()) {
+		r.e = { (uint8_t)magic[0], (uint8_t)magic[1], (uint8_t)magic[2], (uint8_t)magic[3], version };
+	}
+}
+
+void RecordMap(Replay &r, int i) {
+	Header(r);
+	r.e.push_back(RE_MAP);
+	unsigned v = i;
+	for (; v >= 0x80; v >>= 7)
+		r.e.push_back((v & 0x7f) | 0x80);
+	r.e.push_back(v);
+}
+
+void Record(Replay &r, ReplayEvent e) {
+	Header(r);
+	r.e.push_back(e);
+}
+
+void FinishReplay(Replay &r, const Sim &s) {
+	Header(r);
+	r.e.push_back(RE_END);
+	uint64_t h = StateHash(s);
+	for (int i = 0; i < 8; i++)
+		r.e.push_back(h >> (i * 8));
+}
+
+// FNV-1a.
+static void Mix(uint64_t &h, int v) {
+	for (int i = 0; i < 4; i++) {
+		h ^= (uint8_t)(v >> (i * 8));
+		h *= 0x100000001b3ull;
+	}
+}
+
+uint64_t StateHash(const Sim &s) {
+	uint64_t h = 0xcbf29ce484222325ull;
+	Mix(h, s.m.w);
+	Mix(h, s.m.h);
+	Mix(h, s.m.M);
+	Mix(h, s.a.x);
+	Mix(h, s.a.y);
+	Mix(h, s.b.x);
+	Mix(h, s.b.y);
+	for (const Box &b : s.m.b) {
+		Mix(h, b.x);
+		Mix(h, b.y);
+	}
+	for (const Door &d : s.m.d)
+		Mix(h, d.open);
+	return h;
+}
+
+Playback PlayReplay(const uint8_t *r, size_t n) {
+	Playback p;
+	if (n < 5 || memcmp(r, magic, 4) != 0 || r[4] != version)
+		return p;
+
+	Sim s;
+	int map = -1;
+	const uint8_t *e = r + n;
+	for (r += 5; r < e;) {
+		uint8_t c = *r++;
+		if (c < RE_MAP) {
+			if (map < 0)
+				return p; // pressed before any map was loaded
+			p.events++;
+		}
+		switch (c) {
+		case RE_UP:
+			Step(s, 0, -1);
+			break;
+		case RE_DOWN:
+			Step(s, 0, 1);
+			break;
+		case RE_LEFT:
+			Step(s, -1, 0);
+			break;
+		case RE_RIGHT:
+			Step(s, 1, 0);
+			break;
+		case RE_UNDO:
+			Undo(s);
+			break;
+		case RE_RESET:
+			LoadMap(s, MapLevel(map));
+			break;
+		case RE_MAP: {
+			unsigned v = 0;
+			int shift = 0;
+			do {
+				if (r == e || shift > 28)
+					return p;
+				c = *r++;
+				v |= (c & 0x7fu) << shift;
+				shift += 7;
+			} while (c & 0x80);
+			if (v >= (unsigned)mapCount)
+				return p; // recorded against more maps than there are now
+			map = v;
+			p.maps++;
+			LoadMap(s, MapLevel(map));
+			break;
+		}
+		case RE_END:
+			if (e - r != 8)
+				return p;
+			for (int i = 0; i < 8; i++)
+				p.want |= (uint64_t)r[i] << (i * 8);
+			p.got = StateHash(s);
+			p.valid = true;
+			return p;
+		default:
+			return p;
+		}
+	}
+	return p;
+}
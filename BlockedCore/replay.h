@@ -0,0 +1,43 @@
+#pragma once
+
+// A session as it was played: each map as it was loaded and every press on
+// it, a byte a press. Playing one back runs the same Step and Undo the game
+// did, with nothing drawn and nothing waited on, and checks it ends up where
+// the game did.
+
+#include "core.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum ReplayEvent : uint8_t {
+	RE_UP,
+	RE_DOWN,
+	RE_LEFT,
+	RE_RIGHT,
+	RE_UNDO,
+	RE_RESET,
+	RE_MAP, // then the map index as a varint
+	RE_END, // then the final StateHash, 8 bytes little-endian
+};
+
+struct Replay {
+	std::vector<uint8_t> e; // header, then events
+};
+
+void RecordMap(Replay &r, int i);
+void Record(Replay &r, ReplayEvent e);
+// Closes the recording with a hash of where s ended up.
+void FinishReplay(Replay &r, const Sim &s);
+// Who is where, which doors are open and how many moves it took.
+uint64_t StateHash(const Sim &s);
+
+struct Playback {
+	bool valid = false; // read through to RE_END without running off the end
+	int maps = 0;
+	size_t events = 0; // presses
+	uint64_t want = 0; // recorded
+	uint64_t got = 0; // played back
+};
+
+Playback PlayReplay(const uint8_t *r, size_t n);
@@ -0,0 +1,384 @@
+#include "solver.h"
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+static const int dirs[4][2] = { { 0, -1 }, { 0, 1 }, { -1, 0 }, { 1, 0 } };
+
+struct Node {
+	uint64_t k; // packed position
+	int g; // moves so far
+};
+
+// A, B, then every box, each as a cell index `bits` wide, packed into `W`
+// words without straddling any. Boxes all look the same, so they're sorted
+// to fold swapped boxes together.
+static void Pack(const Sim &s, int bits, int W, uint64_t *k, std::vector<int> &boxes) {
+	boxes.clear();
+	for (const Box &b : s.m.b)
+		boxes.push_back(b.y * s.m.w + b.x);
+	std::sort(boxes.begin(), boxes.end());
+
+	int per = 64 / bits;
+	for (int i = 0; i < W; i++)
+		k[i] = 0;
+	auto put = [&](int j, uint64_t v) {
+		k[j / per] |= v << (j % per * bits);
+	};
+	put(0, s.a.y * s.m.w + s.a.x);
+	put(1, s.b.y * s.m.w + s.b.x);
+	for (size_t i = 0; i < boxes.size(); i++)
+		put(2 + (int)i, boxes[i]);
+}
+
+static void Unpack(Sim &s, const uint64_t *k, int bits) {
+	int per = 64 / bits;
+	uint64_t mask = (1ull << bits) - 1;
+	auto get = [&](int j) {
+		return (int)(k[j / per] >> (j % per * bits) & mask);
+	};
+	s.a.x = s.a.lx = get(0) % s.m.w;
+	s.a.y = s.a.ly = get(0) / s.m.w;
+	s.b.x = s.b.lx = get(1) % s.m.w;
+	s.b.y = s.b.ly = get(1) / s.m.w;
+	for (size_t i = 0; i < s.m.b.size(); i++) {
+		Box &b = s.m.b[i];
+		b.x = b.lx = get(2 + (int)i) % s.m.w;
+		b.y = b.ly = get(2 + (int)i) / s.m.w;
+	}
+	PlaceBoxes(s);
+}
+
+static int Bits(const Sim &s) {
+	int bits = 1;
+	while ((1 << bits) < s.m.w * s.m.h)
+		bits++;
+	return bits;
+}
+
+// Words a position takes.
+static int Words(const Sim &s, int bits) {
+	int per = 64 / bits;
+	return (2 + (int)s.m.b.size() + per - 1) / per;
+}
+
+static int Dist(const std::vector<int> &goals, int w, int x, int y) {
+	int best = INT_MAX;
+	for (int g : goals)
+		best = std::min(best, abs(g % w - x) + abs(g / w - y));
+	return best;
+}
+
+// Each press moves a player at most one tile, so the further player's
+// distance to its nearest flag never overestimates.
+static int Estimate(const Sim &s, const std::vector<int> &ga, const std::vector<int> &gb) {
+	return std::max(Dist(ga, s.m.w, s.a.x, s.a.y), Dist(gb, s.m.w, s.b.x, s.b.y));
+}
+
+static void Push(std::vector<std::vector<Node>> &open, Node n, int f) {
+	if (f >= (int)open.size())
+		open.resize(f + 1);
+	open[f].push_back(n);
+}
+
+Solution Solve(const uint8_t *l /* map to solve */) {
+	Solution r;
+	Sim s;
+	LoadMap(s, l);
+
+	int bits = Bits(s);
+	if (Words(s, bits) > 1) {
+		r.o = SOL_TOO_BIG; // SolveParallel takes wider keys
+		return r;
+	}
+
+	std::vector<int> ga;
+	std::vector<int> gb;
+	for (int i = 0; i < s.m.w * s.m.h; i++) {
+		if (s.m.m[i] == T_GOALA)
+			ga.push_back(i);
+		if (s.m.m[i] == T_GOALB)
+			gb.push_back(i);
+	}
+	if (ga.empty() || gb.empty())
+		return r;
+
+	// A* over buckets of f = g + h. The estimate is consistent, so the
+	// first time a position comes off the queue it's been reached optimally.
+	std::vector<std::vector<Node>> open;
+	std::unordered_set<uint64_t> closed;
+	std::vector<int> boxes;
+	uint64_t k;
+	Pack(s, bits, 1, &k, boxes);
+	Push(open, Node{ .k = k, .g = 0 }, Estimate(s, ga, gb));
+
+	for (size_t f = 0; f < open.size(); f++) {
+		while (!open[f].empty()) {
+			Node n = open[f].back();
+			open[f].pop_back();
+			if (!closed.insert(n.k).second)
+				continue;
+
+			Unpack(s, &n.k, bits);
+			r.states++;
+			if (Won(s)) {
+				r.o = SOL_SOLVED;
+				r.moves = n.g;
+				return r;
+			}
+
+			for (const int *d : dirs) {
+				if (!Step(s, d[0], d[1]))
+					continue;
+				// Stepping into fire gets undone by the game, so it's not a move.
+				if (!OnFire(s)) {
+					Pack(s, bits, 1, &k, boxes);
+					if (!closed.count(k))
+						Push(open, Node{ .k = k, .g = n.g + 1 }, n.g + 1 + Estimate(s, ga, gb));
+				}
+				Undo(s);
+			}
+		}
+	}
+	return r;
+}
+
+// Breadth-first, a layer at a time. The threads are started once and meet
+// at a barrier between steps; whichever gets there last does the
+// bookkeeping. Within a layer they take slices off a shared cursor, and
+// positions already seen are kept in one open-addressed table that's
+// claimed slot by slot with compare-and-swap, so nothing takes a lock.
+
+static const size_t sliceSize = 256;
+static const uint64_t busy = 1; // a slot's tag while its key is written
+
+// Tags are 0 for empty, busy, or the key's hash with bit 1 set.
+struct Table {
+	size_t mask = 0;
+	std::unique_ptr<uint64_t[]> tag;
+	std::unique_ptr<uint64_t[]> key; // W words a slot
+};
+
+struct alignas(64) Worker {
+	Sim s;
+	std::vector<uint64_t> next; // found for the next layer, W words each
+	std::vector<int> boxes;
+	size_t at = 0; // where next goes in the next layer
+	size_t expanded = 0;
+};
+
+static uint64_t Hash(const uint64_t *k, int W) {
+	uint64_t h = 0x9E3779B97F4A7C15ull;
+	for (int i = 0; i < W; i++) {
+		h = (h ^ k[i]) * 0xbf58476d1ce4e5b9ull;
+		h ^= h >> 31;
+	}
+	return h;
+}
+
+// Left uninitialised: the threads clear it between them.
+static void Allocate(Table &t, size_t slots, int W) {
+	t.mask = slots - 1;
+	t.tag.reset(new uint64_t[slots]);
+	t.key.reset(new uint64_t[slots * W]);
+}
+
+static bool /* first time seen */ Visit(Table &t, int W, const uint64_t *k) {
+	uint64_t h = Hash(k, W);
+	uint64_t want = h | 2;
+	for (size_t i = (h >> 8) & t.mask;; i = (i + 1) & t.mask) {
+		std::atomic_ref<uint64_t> tag(t.tag[i]);
+		uint64_t v = tag.load(std::memory_order_acquire);
+		if (v == 0) {
+			if (tag.compare_exchange_strong(v, busy, std::memory_order_acquire)) {
+				memcpy(&t.key[i * W], k, W * sizeof(uint64_t));
+				tag.store(want, std::memory_order_release);
+				return true;
+			}
+		}
+		while (v == busy)
+			v = tag.load(std::memory_order_acquire);
+		if (v == want && memcmp(&t.key[i * W], k, W * sizeof(uint64_t)) == 0)
+			return false;
+	}
+}
+
+// Self's share of [0, n).
+static std::pair<size_t, size_t> Stripe(size_t n, int threads, int self) {
+	return { n * self / threads, n * (self + 1) / threads };
+}
+
+Solution SolveParallel(const uint8_t *l /* map to solve */, int threads) {
+	Solution r;
+	Sim s;
+	LoadMap(s, l);
+	if (threads < 1)
+		threads = 1;
+
+	if (Won(s)) {
+		r.o = SOL_SOLVED;
+		r.moves = 0;
+		return r;
+	}
+
+	int bits = Bits(s);
+	int W = Words(s, bits);
+
+	std::vector<Worker> workers(threads);
+	for (Worker &w : workers)
+		w.s = s;
+
+	Table seen;
+	Table old; // while it's being moved into a bigger seen
+	Allocate(seen, 1 << 16, W);
+	memset(seen.tag.get(), 0, (seen.mask + 1) * sizeof(uint64_t));
+	size_t found = 1;
+
+	std::unique_ptr<uint64_t[]> layer(new uint64_t[W]);
+	std::unique_ptr<uint64_t[]> next;
+	size_t layerSize = 1;
+	size_t layerRoom = 1; // positions it has space for
+	size_t nextSize = 0;
+	size_t nextRoom = 0;
+	Pack(s, bits, W, layer.get(), workers[0].boxes);
+	Visit(seen, W, layer.get());
+
+	std::atomic<size_t> cursor = 0;
+	std::atomic<bool> won = false;
+	bool done = false;
+	bool grow = false;
+	int g = 1;
+
+	// After expanding: lay out the next layer and make room for what it
+	// can turn up, so the table stays under half full.
+	auto expanded = [&]() noexcept {
+		if (won) {
+			r.o = SOL_SOLVED;
+			r.moves = g;
+			done = true;
+			return;
+		}
+		nextSize = 0;
+		for (Worker &w : workers) {
+			w.at = nextSize;
+			nextSize += w.next.size() / W;
+		}
+		if (!nextSize) {
+			done = true;
+			return;
+		}
+		if (nextSize > nextRoom) {
+			nextRoom = nextSize + nextSize / 2;
+			next.reset(new uint64_t[nextRoom * W]);
+		}
+		found += nextSize;
+		size_t need = (found + 4 * nextSize) * 2;
+		grow = need > seen.mask + 1;
+		if (grow) {
+			size_t slots = seen.mask + 1;
+			while (slots < need * 2)
+				slots *= 2;
+			old = std::move(seen);
+			Allocate(seen, slots, W);
+		}
+	};
+	auto assembled = [&]() noexcept {
+		std::swap(layer, next);
+		std::swap(layerRoom, nextRoom);
+		layerSize = nextSize;
+		cursor = 0;
+		g++;
+	};
+	// The last thread to arrive does the step's bookkeeping: after expanding,
+	// after gathering, and after moving into a bigger table.
+	int phase = 0;
+	std::barrier step(threads, [&]() noexcept {
+		switch (phase) {
+		case 0:
+			expanded();
+			phase = done ? 0 : 1;
+			break;
+		case 1:
+			assembled();
+			phase = grow ? 2 : 0;
+			break;
+		case 2:
+			old = {};
+			grow = false;
+			phase = 0;
+			break;
+		}
+	});
+
+	auto work = [&](int self) {
+		Worker &w = workers[self];
+		Sim &S = w.s;
+		std::vector<uint64_t> k(W);
+		for (;;) {
+			for (;;) {
+				size_t i = cursor.fetch_add(sliceSize, std::memory_order_relaxed);
+				if (i >= layerSize || won.load(std::memory_order_relaxed))
+					break;
+				size_t end = std::min(i + sliceSize, layerSize);
+				for (; i < end; i++) {
+					Unpack(S, &layer[i * W], bits);
+					w.expanded++;
+					for (const int *d : dirs) {
+						if (!Step(S, d[0], d[1]))
+							continue;
+						if (!OnFire(S)) {
+							Pack(S, bits, W, k.data(), w.boxes);
+							if (Visit(seen, W, k.data())) {
+								if (Won(S))
+									won = true;
+								w.next.insert(w.next.end(), k.begin(), k.end());
+							}
+						}
+						Undo(S);
+					}
+				}
+			}
+			step.arrive_and_wait();
+			if (done)
+				return;
+
+			// Gather the next layer, and clear this thread's share of the
+			// bigger table if there's about to be one.
+			std::copy(w.next.begin(), w.next.end(), &next[w.at * W]);
+			w.next.clear();
+			if (grow) {
+				auto [from, to] = Stripe(seen.mask + 1, threads, self);
+				memset(&seen.tag[from], 0, (to - from) * sizeof(uint64_t));
+			}
+			bool moving = grow;
+			step.arrive_and_wait();
+
+			if (moving) {
+				auto [from, to] = Stripe(old.mask + 1, threads, self);
+				for (size_t i = from; i < to; i++)
+					if (old.tag[i])
+						Visit(seen, W, &old.key[i * W]);
+				step.arrive_and_wait();
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (int i = 1; i < threads; i++)
+		pool.emplace_back(work, i);
+	work(0);
+	for (std::thread &t : pool)
+		t.join();
+
+	for (Worker &w : workers)
+		r.states += w.expanded;
+	return r;
+}
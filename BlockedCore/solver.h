@@ -0,0 +1,26 @@
+#pragma once
+
+// Finds par for a map: the fewest arrow presses that get both players onto
+// their flags, played by the same rules as the game.
+
+#include "core.h"
+#include <cstddef>
+#include <cstdint>
+
+enum Outcome : uint8_t {
+	SOL_SOLVED,
+	SOL_STUCK, // there's no way through
+	SOL_TOO_BIG, // too many tiles and boxes to pack a position into Solve's 64-bit key
+};
+
+struct Solution {
+	Outcome o = SOL_STUCK;
+	int moves = -1; // only when SOL_SOLVED
+	size_t states = 0; // positions expanded
+};
+
+Solution Solve(const uint8_t *l /* map to solve */);
+// Breadth-first over `threads` workers, for maps too big to search on one.
+// Positions take as many 64-bit words as they need, so it never gives up
+// with SOL_TOO_BIG.
+Solution SolveParallel(const uint8_t *l /* map to solve */, int threads);
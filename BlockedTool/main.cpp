@@ -0,0 +1,266 @@
+#include "core.h"
+#include "replay.h"
+#include "solver.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Headless batch jobs over the built-in maps.
+
+// Also checks the pars the game shows, and fails if any are out of date.
+static int Par(int threads) {
+	int stale = 0;
+	for (int i = 0; i < mapCount; i++) {
+		Sim s;
+		LoadMap(s, MapLevel(i));
+		Solution r = threads > 0 ? SolveParallel(MapLevel(i), threads) : Solve(MapLevel(i));
+		switch (r.o) {
+		case SOL_SOLVED:
+			printf("%2d %-20s par %d (%zu states)", i, s.m.n.c_str(), r.moves, r.states);
+			break;
+		case SOL_STUCK:
+			printf("%2d %-20s unsolvable (%zu states)", i, s.m.n.c_str(), r.states);
+			break;
+		case SOL_TOO_BIG:
+			printf("%2d %-20s too big to search", i, s.m.n.c_str());
+			break;
+		}
+		if (r.moves != MapPar(i)) {
+			printf(", but maps.cpp says %d", MapPar(i));
+			stale++;
+		}
+		printf("\n");
+	}
+	return stale ? 1 : 0;
+}
+
+// A, B, then each box, as tile indices, the same as a Snapshot holds them.
+static std::vector<int> Where(const Sim &s) {
+	std::vector<int> p = { s.a.y * s.m.w + s.a.x, s.b.y * s.m.w + s.b.x };
+	for (const Box &b : s.m.b)
+		p.push_back(b.y * s.m.w + b.x);
+	return p;
+}
+
+// Walks every built-in map at random with a small history cap, so trimming
+// happens often, and checks Undo and PositionAt against where things were.
+static int UndoCheck(size_t cap) {
+	static const int dirs[4][2] = { { 0, -1 }, { 0, 1 }, { -1, 0 }, { 1, 0 } };
+	int bad = 0;
+	for (int i = 0; i < mapCount; i++) {
+		Sim s;
+		s.m.u.cap = cap;
+		s.m.u.every = 16;
+		LoadMap(s, MapLevel(i));
+		std::vector<std::vector<int>> seen = { Where(s) }; // after each move
+		srand(i);
+		int wrong = 0;
+		for (int step = 0; step < 20000; step++) {
+			int d = rand() % 4;
+			if (Step(s, dirs[d][0], dirs[d][1]))
+				seen.push_back(Where(s));
+			if (rand() % 50 == 0) {
+				seen.resize(seen.size() - Undo(s, rand() % 10 + 1));
+				if (seen.back() != Where(s))
+					wrong++;
+			}
+			if (rand() % 20 == 0) {
+				int m = rand() % (s.m.M + 1);
+				Snapshot k;
+				bool held = PositionAt(s, m, k);
+				if (held != (m >= s.m.u.base) || (held && std::vector<int>(k.p.begin(), k.p.end()) != seen[m]))
+					wrong++;
+			}
+		}
+		if (s.m.M != (int)seen.size() - 1)
+			wrong++;
+		while (Undo(s, 7)) {
+		}
+		if (s.m.M != s.m.u.base || seen[s.m.M] != Where(s))
+			wrong++;
+		printf("%2d %-20s %d moves kept of %zu, %d wrong\n", i, s.m.n.c_str(), (int)seen.size() - 1 - s.m.u.base, seen.size() - 1, wrong);
+		bad += wrong;
+	}
+	return bad ? 1 : 0;
+}
+
+// CheckLevel against every cut-short copy of the built-in maps, and against
+// sizes that mustn't load, in both the string syntax and compiled.
+static int LevelCheck() {
+	int bad = 0;
+	for (int i = 0; i < mapCount; i++) {
+		// The name runs to the end, so only the whole level passes.
+		const uint8_t *l = MapLevel(i);
+		size_t size = 0;
+		while (size < 1 << 16 && !CheckLevel(l, size))
+			size++;
+		Sim s, t;
+		LoadMap(t, l);
+		if (size == 1 << 16 || !LoadMap(s, l, size) || Where(s) != Where(t) || s.m.n != t.m.n) {
+			printf("%2d %-20s doesn't pass whole\n", i, t.m.n.c_str());
+			bad++;
+		}
+		else
+			printf("%2d %-20s %zu bytes, every shorter one turned down\n", i, t.m.n.c_str(), size);
+	}
+
+	static const struct {
+		const char *src;
+		const char *why;
+	} sources[] = {
+		{ "(50000,50000)ab", "map too big" },
+		{ "(4097,4097)ab", "map too big" },
+		{ "(0,1)a", "size out of range" },
+		{ "(65536,1)a", "size should read (w,h)" },
+		{ "(99999999999,2)ab", "size should read (w,h)" },
+	};
+	for (const auto &c : sources) {
+		Level l;
+		const char *why = nullptr;
+		if (CompileMap(c.src, l, &why) || !why || strcmp(why, c.why) != 0) {
+			printf("%s: wanted \"%s\", got \"%s\"\n", c.src, c.why, why ? why : "ok");
+			bad++;
+		}
+	}
+
+	// Varint width and height, with no tiles after them.
+	static const struct {
+		uint8_t l[6];
+		const char *why;
+	} levels[] = {
+		{ { 0xff, 0xff, 0x03, 0xff, 0xff, 0x03 }, "map too big" },
+		{ { 0x81, 0x20, 0x81, 0x20, 0x00, 0x00 }, "map too big" },
+		{ { 0x80, 0x80, 0x04, 0x01, 0x00, 0x00 }, "size out of range" },
+		{ { 0xff, 0xff, 0xff, 0xff, 0x0f, 0x02 }, "size out of range" },
+	};
+	for (const auto &c : levels) {
+		Sim s;
+		const char *why = nullptr;
+		if (LoadMap(s, c.l, sizeof(c.l), &why) || !why || strcmp(why, c.why) != 0) {
+			printf("level %02x %02x %02x...: wanted \"%s\", got \"%s\"\n", c.l[0], c.l[1], c.l[2], c.why, why ? why : "ok");
+			bad++;
+		}
+	}
+	printf("%zu bad sizes, %d wrong in all\n", std::size(sources) + std::size(levels), bad);
+	return bad ? 1 : 0;
+}
+
+// Turns a map written in the string syntax into a compiled level.
+static int Compile(const char *in, const char *out) {
+	std::ifstream f(in, std::ios::binary);
+	if (!f) {
+		printf("can't open %s\n", in);
+		return 1;
+	}
+	std::string src((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	// Rows can sit on lines of their own, the way they do in maps.cpp.
+	src.erase(std::remove_if(src.begin(), src.end(), [](char c) { return c == '\n' || c == '\r'; }), src.end());
+
+	Level l;
+	const char *why = nullptr;
+	if (!CompileMap(src.c_str(), l, &why)) {
+		printf("%s isn't a valid map: %s\n", in, why);
+		return 1;
+	}
+	std::ofstream o(out, std::ios::binary);
+	if (!o.write((const char *)l.data(), l.size())) {
+		printf("can't write %s\n", out);
+		return 1;
+	}
+	printf("%s: %zu source bytes, %zu compiled\n", in, src.size(), l.size());
+	return 0;
+}
+
+// Par for compiled maps, as written by compile.
+static int SolveFiles(int n, char **files, int threads) {
+	int bad = 0;
+	for (int i = 0; i < n; i++) {
+		std::ifstream f(files[i], std::ios::binary);
+		std::string l((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		Sim s;
+		const char *why = "can't open it";
+		if (!f || !LoadMap(s, (const uint8_t *)l.data(), l.size(), &why)) {
+			printf("%s: not a level: %s\n", files[i], why);
+			bad++;
+			continue;
+		}
+		Solution r = threads > 0 ? SolveParallel((const uint8_t *)l.data(), threads) : Solve((const uint8_t *)l.data());
+		switch (r.o) {
+		case SOL_SOLVED:
+			printf("%s: %s, par %d (%zu states)\n", files[i], s.m.n.c_str(), r.moves, r.states);
+			break;
+		case SOL_STUCK:
+			printf("%s: %s, unsolvable (%zu states)\n", files[i], s.m.n.c_str(), r.states);
+			break;
+		case SOL_TOO_BIG:
+			printf("%s: %s, too big to search; try -j\n", files[i], s.m.n.c_str());
+			break;
+		}
+	}
+	return bad ? 1 : 0;
+}
+
+// Plays recorded sessions back as fast as they'll go and checks each ends
+// where it did when it was recorded, so rule changes can be tried against them.
+static int Replays(int n, char **files) {
+	int bad = 0;
+	size_t events = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < n; i++) {
+		std::ifstream f(files[i], std::ios::binary);
+		std::string r((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		Playback p = PlayReplay((const uint8_t *)r.data(), r.size());
+		events += p.events;
+		if (!p.valid) {
+			printf("%s: not a replay, or not one for these maps\n", files[i]);
+			bad++;
+		}
+		else if (p.got != p.want) {
+			printf("%s: ends somewhere else (%d maps, %zu presses)\n", files[i], p.maps, p.events);
+			bad++;
+		}
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	printf("%d replays, %d bad, %zu presses in %.1f ms\n", n, bad, events, ms);
+	return bad ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc >= 2 && strcmp(argv[1], "par") == 0) {
+		int threads = 0; // 0 runs the single-threaded A*
+		if (argc >= 4 && strcmp(argv[2], "-j") == 0)
+			threads = atoi(argv[3]);
+		return Par(threads);
+	}
+	if (argc >= 2 && strcmp(argv[1], "undo") == 0)
+		return UndoCheck(argc >= 3 ? atoi(argv[2]) : 4096);
+	if (argc == 2 && strcmp(argv[1], "levels") == 0)
+		return LevelCheck();
+	if (argc == 4 && strcmp(argv[1], "compile") == 0)
+		return Compile(argv[2], argv[3]);
+	if (argc >= 3 && strcmp(argv[1], "solve") == 0) {
+		int threads = 0;
+		int first = 2;
+		if (argc >= 5 && strcmp(argv[2], "-j") == 0) {
+			threads = atoi(argv[3]);
+			first = 4;
+		}
+		return SolveFiles(argc - first, argv + first, threads);
+	}
+	if (argc >= 3 && strcmp(argv[1], "replay") == 0)
+		return Replays(argc - 2, argv + 2);
+
+	printf("usage: blockedtool par [-j threads]\n");
+	printf("       blockedtool undo [history cap]\n");
+	printf("       blockedtool levels\n");
+	printf("       blockedtool compile <map.txt> <map.lvl>\n");
+	printf("       blockedtool solve [-j threads] <map.lvl>...\n");
+	printf("       blockedtool replay <session.rpl>...\n");
+	return 1;
+}
@@ -1,9 +1,11 @@
 #include "global.h"
+#include "pack.h"
 
 // WHATEVER YOU DO, DO NOT ADD CLASSES PLEASE FOR THE LOVE OF GOD. OR, IF YOU DO, THINK ABOUT IT. THINK "DO I NEED THIS". THINK THAT AND THEN SAY /NO/!
 
 #ifdef _DEBUG
  #define FORCE_EDITION 0
+ #define HOT_RELOAD
 #endif
 
 static bool updated = false;
@@ -20,7 +22,14 @@ bool PickFlags() {
 
 	int sel = 0;
 	Color overflow = BLACK;
+	bool drawn = false;
 	while (!WindowShouldClose()) {
+		// Only redrawn once there's been input.
+		bool input = IsKeyPressed(KEY_UP) || IsKeyPressed(KEY_DOWN) || IsKeyPressed(KEY_ENTER) || IsWindowResized();
+		if (drawn && !input)
+			WaitForEvents();
+		drawn = true;
+
 		if (IsKeyPressed(KEY_UP)) {
 			sel--;
 			PlaySound(SND_MENU);
@@ -68,9 +77,12 @@ bool PickFlags() {
 	return false;
 }
 
+void QueueSprites();
+void SetTickRate(int hz);
+void SetReplayPath(const char *path);
 bool TrijamRunGame();
 
-int main() {
+int main(int argc, char **argv) {
 	/*{
 		R r = RRead("save.dat");
 		if (r.file) {
@@ -80,12 +92,46 @@ int main() {
 		RClose(r);
 	}*/
 
+	bool hot = false;
+#ifdef HOT_RELOAD
+	hot = true;
+#endif
+	const char *pack = nullptr;
+	bool uncapped = false;
+	for (int i = 1; i < argc; i++) {
+		if (TextIsEqual(argv[i], "-hotreload"))
+			hot = true;
+		if (TextIsEqual(argv[i], "-uncapped"))
+			uncapped = true; // no vsync: draw as fast as it'll go
+		if (TextIsEqual(argv[i], "-tickrate") && i + 1 < argc)
+			SetTickRate(TextToInteger(argv[++i]));
+		if (TextIsEqual(argv[i], "-record") && i + 1 < argc)
+			SetReplayPath(argv[++i]); // overwritten by each run
+		if (TextIsEqual(argv[i], "-pack") && i + 1 < argc)
+			pack = argv[++i];
+	}
+
+	// Build step: decode everything into one pack and quit.
+	if (pack) {
+		QueueSounds();
+		QueueSprites();
+		return PackQueuedAssets(pack) ? 0 : 1;
+	}
+
+	SetConfigFlags(FLAG_WINDOW_RESIZABLE | (uncapped ? 0 : FLAG_VSYNC_HINT));
 	InitWindow(SCRWID, SCRHEI, "Blocked");
 	InitAudioDevice();
+	InitMusic();
+	EnableHotReload(hot);
+	if (!OpenPack("assets.pak"))
+		TraceLog(LOG_INFO, "PACK: No assets.pak, loading loose files");
+	QueueSounds();
+	QueueSprites();
+	LoadQueuedAssets();
 	LoadSounds();
 	SetExitKey(0);
-
-	SetTargetFPS(30);
+	if (!hot)
+		StartSoundThread();
 
 	if (!PickFlags())
 		goto END;
@@ -93,5 +139,9 @@ int main() {
 	while (TrijamRunGame());
 
 END:
+	StopSoundThread();
+	UnloadMusic();
+	UnloadAssets();
+	ClosePack();
 	CloseWindow();
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 #include "global.h"
+#include "core.h"
+#include "replay.h"
 #include <unordered_set>
 #include <string>
 
-static struct Particle {
+struct Particle {
 	float r;
 	int x;
 	int sy;
@@ -27,108 +29,23 @@ static void AddParticles(int sx, int sy) {
 }
 
 static bool GameOver() {
-	StopSound(SND_MUSIC);
+	StopMusic(1);
+	bool drawn = false;
 	while (!WindowShouldClose()) {
+		// Nothing moves on this screen, so it's only redrawn when something happens.
+		if (drawn && !IsWindowResized())
+			WaitForEvents();
+		drawn = true;
+
 		BeginDrawing();
 		ClearBackground(BLACK);
-		DrawText("You Won!", (800 - MeasureText("You Won!", 60)) / 2, 100, 60, WHITE);
+		DrawText("You Won!", (GetScreenWidth() - MeasureText("You Won!", 60)) / 2, 100, 60, WHITE);
 		//DrawKeybindBar("", "");
 		EndDrawing();
 	}
 	return false;
 }
 
-const char *maps[] = {
-	"44a  B"
-	"||    "
-	"||    "
-	"||A  b"
-	"Straight Across",
-
-	"84a       "
-	"||  B *   "
-	"||     A  "
-	"||       b"
-	"Flipped Flags",
-
-	"98a       B"
-	"||         "
-	"||      ***"
-	"||A*       "
-	"||   ***   "
-	"||   ***   "
-	"||   ***   "
-	"||   ***  b"
-	"Into the Ceiling",
-
-	"98a        "
-	"||      .  "
-	"||  _      "
-	"|| ******* "
-	"|| *B*   & "
-	"|| *A    & "
-	"|| ******* "
-	"||        b"
-	"00" // doors
-	"Button & Box",
-
-	"97a  &  v  " // d0
-	"|| _ &  _. " // b0 d1 b1
-	"||   &.b   " // d2
-	"||*&**    ^" // d3
-	"||A   *&***" // d4
-	"|| _.      " // b2
-	"||        B"
-	"11102" // doors
-	"Three Doors"
-};
-
-enum Tile {
-	T_AIR,
-	T_SOLID,
-	T_GOALA,
-	T_GOALB,
-	T_SOLIDBOTTOM,
-	T_SOLIDTOP,
-	T_FIRE
-};
-
-struct Box {
-	int x;
-	int y;
-	int lx;
-	int ly;
-	int id;
-};
-
-struct Button {
-	int x;
-	int y;
-};
-
-struct Door {
-	int x;
-	int y;
-	int bRef;
-};
-
-enum TurnType {
-	TRN_LABEL,
-	TRN_BOX,
-	TRN_PLAYER
-};
-
-struct Turn {
-	int type;
-	int fX;
-	int tX;
-	int fY;
-	int tY;
-	int id;
-	int lX;
-	int lY;
-};
-
 enum Animation {
 	ANIM_FIRE,
 	ANIM_TURN,
@@ -149,85 +66,152 @@ float AnimationTime(Animation a) {
 	}
 }
 
-struct Map {
-	int M = 0; // moves;
-	int w;
-	int h;
-	const char *n;
-	Tile *m = nullptr; // map data
-	std::vector<Box> b; // boxes
-	std::vector<Button> B; // buttons
-	std::vector<Door> d; // doors
-	std::vector<Turn> t; // turns
+// Presses are queued as they come in and played back as soon as the board
+// can take them, so nothing's lost to an animation.
+enum Action {
+	ACT_UP,
+	ACT_DOWN,
+	ACT_LEFT,
+	ACT_RIGHT,
+	ACT_UNDO,
+	ACT_RESET
 };
 
-struct Player {
-	int x;
-	int y;
-	int lx;
-	int ly;
-	bool w; // won
+struct Input {
+	Action a;
+	double t; // when it was pressed
+};
+
+#define MAX_TICKS 8 // most logic ticks run to catch up in one frame
+#define INPUT_MAX 16 // presses waiting at once; any more are dropped
+#define HURRY_AFTER 0.05 // seconds a press waits before animations speed up for it
+
+enum Sprite {
+	SPR_BG,
+	SPR_BOX,
+	SPR_CLOSED,
+	SPR_OPEN,
+	SPR_DEATH,
+	SPR_HOLE,
+	SPR_P1,
+	SPR_P2,
+	SPR_WALL,
+	SPR_WALLB,
+	SPR_WALLT,
+	SPR_P1F,
+	SPR_P2F,
+
+	SPR_COUNT
 };
 
+static const char *spriteFiles[SPR_COUNT] = {
+	"Background.png",
+	"Box.png",
+	"Closed_Gate.png",
+	"OpenGate.png",
+	"Death.png",
+	"hole.png",
+	"P1.png",
+	"P2.png",
+	"Wall.png",
+	"Wall_bottom_only.png",
+	"Wall_Top_Only.png",
+	"RedFlag.png",
+	"BlueFlag.png"
+};
+
+void QueueSprites() {
+	for (const char *f : spriteFiles)
+		QueueImage(f);
+}
+
 struct Textures {
-	Texture2D bg;
-	Texture2D box;
-	Texture2D closed;
-	Texture2D open;
-	Texture2D death;
-	Texture2D hole;
-	Texture2D p1;
-	Texture2D p2;
-	Texture2D wall;
-	Texture2D wallb;
-	Texture2D wallt;
-	Texture2D p1f;
-	Texture2D p2f;
+	AssetID img[SPR_COUNT]; // decoded once per process, in the asset cache
+	int v[SPR_COUNT]; // the versions the atlas was built from
+	Texture2D atlas;
+	Rectangle r[SPR_COUNT]; // where each sprite sits in the atlas
 
 	void Load() {
-		bg = LoadTexture("Background.png");
-		box = LoadTexture("Box.png");
-		closed = LoadTexture("Closed_Gate.png");
-		death = LoadTexture("Death.png");
-		hole = LoadTexture("hole.png");
-		open = LoadTexture("OpenGate.png");
-		p1 = LoadTexture("P1.png");
-		p2 = LoadTexture("P2.png");
-		wall = LoadTexture("Wall.png");
-		wallb = LoadTexture("Wall_bottom_only.png");
-		wallt = LoadTexture("Wall_Top_Only.png");
-		p1f = LoadTexture("RedFlag.png");
-		p2f = LoadTexture("BlueFlag.png");
+		for (int i = 0; i < SPR_COUNT; i++)
+			img[i] = AcquireImage(spriteFiles[i]);
+		Build();
+	}
+
+	// Everything goes in one strip, so the whole board draws off one texture.
+	void Build() {
+		int w = 0;
+		int h = 0;
+		for (int i = 0; i < SPR_COUNT; i++) {
+			Image m = AssetImage(img[i]);
+			w += m.width;
+			h = Max(h, m.height);
+		}
+
+		Image a = GenImageColor(w, h, BLANK);
+		int x = 0;
+		for (int i = 0; i < SPR_COUNT; i++) {
+			Image m = AssetImage(img[i]);
+			Rectangle src{ 0, 0, (float)m.width, (float)m.height };
+			r[i] = Rectangle{ (float)x, 0, src.width, src.height };
+			ImageDraw(&a, m, src, r[i], WHITE);
+			x += m.width;
+			v[i] = AssetVersion(img[i]);
+		}
+		atlas = LoadTextureFromImage(a);
+		UnloadImage(a);
+	}
+
+	bool /* rebuilt */ Refresh() {
+		for (int i = 0; i < SPR_COUNT; i++) {
+			if (AssetVersion(img[i]) != v[i]) {
+				UnloadTexture(atlas);
+				Build();
+				return true;
+			}
+		}
+		return false;
 	}
 
 	void Unload() {
-		UnloadTexture(bg);
-		UnloadTexture(box);
-		UnloadTexture(closed);
-		UnloadTexture(death);
-		UnloadTexture(hole);
-		UnloadTexture(open);
-		UnloadTexture(p1);
-		UnloadTexture(p2);
-		UnloadTexture(wall);
-		UnloadTexture(wallb);
-		UnloadTexture(wallt);
-		UnloadTexture(p1f);
-		UnloadTexture(p2f);
+		UnloadTexture(atlas);
+		for (int i = 0; i < SPR_COUNT; i++)
+			ReleaseAsset(img[i]);
 	}
 };
 
-struct State {
+struct State : Sim {
 	int M = -1; // map index
 	int tM = 0; // total moves
-	Map m;
-	Player a;
-	Player b;
+	int par = -1; // fewest moves for this map, or -1 if it isn't known
 	Animation A = ANIM_TURN;
 	float at = 100;
 	Textures t;
+	RenderTexture2D board{}; // everything that can't move, drawn once per map
+	int border = 0; // wall tiles around the map in board
+	RenderTexture2D view{}; // the board at one texel per pixel, scaled up onto the screen
+	std::vector<float> dt; // time since each door last opened or shut
+	std::deque<Input> in; // oldest first
+	bool hurry = true; // speed animations up while presses are waiting
+	double clock = 0; // logic time in seconds, moved on a tick at a time
+	double lag = 0; // real time that hasn't been ticked through yet
+	double last = 0; // when lag was last topped up
+	bool settled = false; // a tick has gone by with nothing moving and nothing to do
+	bool shown = false; // the last frame drawn shows the board settled
+	float da = 100; // at, carried on past the last tick for drawing
+	Replay rec; // this run, for blockedtool replay
 } s;
 
+static int tickRate = 60; // logic ticks a second, whatever the frame rate
+static const char *recordTo = nullptr; // where each run's replay goes
+
+void SetTickRate(int hz) {
+	tickRate = Max(hz, 1);
+}
+
+void SetReplayPath(const char *path) {
+	recordTo = path;
+}
+
 void PlayAnimation(Animation a) {
 	s.A = a;
 	s.at = 0;
@@ -237,486 +221,472 @@ float AnimationTime() {
 	return AnimationTime(s.A);
 }
 
-void LoadMap(const char *m /* map to load */) {
-	if (s.m.m)
-		delete s.m.m;
-	s.m.b = {};
-	s.m.B = {};
-	s.m.d = {};
-	s.m.t = {};
-	s.m.w = (*m++) - '0';
-	s.m.h = (*m++) - '0';
-	s.m.m = new Tile[s.m.w * s.m.h];
-	s.a.w = false;
-	s.b.w = false;
-	s.m.M = 0;
-	PlayAnimation(ANIM_OPEN);
-	int idx = 0;
-	while (idx < s.m.w * s.m.h && *m) {
-		int x = idx % s.m.w;
-		int y = idx / s.m.w;
-		switch (*m) {
-		case '|':
-			idx--;
-			break;
-		case 'a':
-			s.a.x = x;
-			s.a.y = y;
-			s.a.lx = x;
-			s.a.ly = y;
-			s.m.m[idx] = T_AIR;
-			break;
-		case 'b':
-			s.b.x = x;
-			s.b.y = y;
-			s.b.lx = x;
-			s.b.ly = y;
-			s.m.m[idx] = T_AIR;
-			break;
-		case ' ':
-			s.m.m[idx] = T_AIR;
-			break;
-		case 'A':
-			s.m.m[idx] = T_GOALA;
-			break;
-		case 'B':
-			s.m.m[idx] = T_GOALB;
-			break;
-		case '*':
-			s.m.m[idx] = T_SOLID;
-			break;
-		case '.':
-			s.m.m[idx] = T_AIR;
-			s.m.b.push_back(Box{ .x = x, .y = y, .lx = x, .ly = y, .id = (int)s.m.b.size() });
-			break;
-		case '_':
-			s.m.m[idx] = T_AIR;
-			s.m.B.push_back(Button{ .x = x, .y = y });
-			break;
-		case '&':
-			s.m.m[idx] = T_AIR;
-			s.m.d.push_back(Door{ .x = x, .y = y, .bRef = -1 });
-			break;
-		case 'v':
-			s.m.m[idx] = T_SOLIDBOTTOM;
-			break;
-		case '^':
-			s.m.m[idx] = T_SOLIDTOP;
-			break;
-		case '+':
-			idx -= 2;
-			break;
-		case '!':
-			s.m.m[idx] = T_FIRE;
-			break;
-		default:
-			throw;
-			break;
-		}
-		m++;
-		idx++;
-	}
-
-	for (Door &d : s.m.d) {
-		d.bRef = (*m++) - '0';
-	}
-
-	s.m.n = m;
-}
-
-bool /* game over */ LoadNextMap() {
-	PlaySound(SND_WIN);
-	SetSoundVolume(GetSound(SND_WIN), 2);
-	if (++s.M >= sizeof(maps) / sizeof(maps[0])) {
-		return true;
-	}
-	LoadMap(maps[s.M]);
-	return false;
+void DrawTile(Sprite c, float x, float y, float scale = 1) {
+	DrawSprite(s.t.r[c], x, y, scale);
 }
 
-void ReloadMap() {
-	s.tM -= s.m.M;
-	LoadMap(maps[s.M]);
+// Fits the map plus half a tile either side into the window, at a whole-number zoom.
+int Zoom() {
+	int z = Min(GetScreenWidth() / (s.m.w * 16 + 16), GetScreenHeight() / (s.m.h * 16 + 16));
+	return Max(z, 1);
 }
 
-bool DoorOpen(const Door &d) {
-	const Button &B = s.m.B[d.bRef];
-	for (const Box &b : s.m.b) {
-		if (b.x == B.x && b.y == B.y)
-			return true;
+// Floor, walls, flags, fire and buttons never change within a map, so they're
+// drawn into s.board once and that's blitted every frame.
+void BakeBoard() {
+	// Enough walls to reach the edges of the view.
+	int z = Zoom();
+	int bw = (GetScreenWidth() / z / 16 - s.m.w) / 2 + 1;
+	int bh = (GetScreenHeight() / z / 16 - s.m.h) / 2 + 1;
+	s.border = Max(5, Max(bw, bh));
+
+	if (s.board.id)
+		UnloadRenderTexture(s.board);
+	s.board = LoadRenderTexture((s.m.w + s.border * 2) * 16, (s.m.h + s.border * 2) * 16);
+
+	Camera2D c{ 0 };
+	c.offset.x = s.border * 16;
+	c.offset.y = s.border * 16;
+	c.zoom = 1;
+
+	BeginTextureMode(s.board);
+	ClearBackground(BLANK);
+	BeginMode2D(c);
+	BeginSprites(s.t.atlas);
+
+	for (int y = -s.border; y < s.m.h + s.border; y++) {
+		for (int x = -s.border; x < s.m.w + s.border; x++) {
+			if (x >= 0 && x < s.m.w
+				&& y >= 0 && y < s.m.h)
+				continue;
+			DrawTile(SPR_WALL, x * 16, y * 16);
+		}
 	}
-	return false;
-}
-
-void Undo() {
-	if (s.m.t.empty())
-		return;
-
-	Turn t = s.m.t.back();
-	s.m.t.pop_back();
-	s.tM--;
-	s.m.M--;
 
-	for (int i = 0; i < t.id; i++) {
-		Turn T = s.m.t.back();
-		s.m.t.pop_back();
-
-		switch (T.type) {
-		case TRN_LABEL:
-			break;
-		case TRN_BOX:
-			s.m.b[T.id].x = T.fX;
-			s.m.b[T.id].y = T.fY;
-			break;
-		case TRN_PLAYER:
-			if (T.id == 0) {
-				s.a.x = T.fX;
-				s.a.y = T.fY;
-				s.a.lx = T.lX;
-				s.a.ly = T.lY;
-			}
-			else {
-				s.b.x = T.fX;
-				s.b.y = T.fY;
-				s.b.lx = T.lX;
-				s.b.ly = T.lY;
+	for (int y = 0; y < s.m.h; y++) {
+		for (int x = 0; x < s.m.w; x++) {
+			int i = y * s.m.w + x;
+			Tile t = s.m.m[i];
+			switch (t) {
+			case T_AIR:
+				DrawTile(SPR_BG, x * 16, y * 16);
+				break;
+			case T_SOLID:
+				DrawTile(SPR_WALL, x * 16, y * 16);
+				break;
+			case T_GOALA:
+				DrawTile(SPR_BG, x * 16, y * 16);
+				DrawTile(SPR_P1F, x * 16, y * 16);
+				break;
+			case T_GOALB:
+				DrawTile(SPR_BG, x * 16, y * 16);
+				DrawTile(SPR_P2F, x * 16, y * 16);
+				break;
+			case T_SOLIDBOTTOM:
+				DrawTile(SPR_BG, x * 16, y * 16);
+				DrawTile(SPR_WALLB, x * 16, y * 16);
+				break;
+			case T_SOLIDTOP:
+				DrawTile(SPR_BG, x * 16, y * 16);
+				DrawTile(SPR_WALLT, x * 16, y * 16);
+				break;
+			case T_FIRE:
+				DrawTile(SPR_DEATH, x * 16, y * 16);
+				break;
+			default: // T_COUNT is never stored
+				break;
 			}
 		}
 	}
-}
 
-template <class T>
-bool /* success */ TryMove(T &m, Player &o, int x, int y) {
-	//if (m.w)
-	//	return false;
-
-	m.lx = m.x;
-	m.ly = m.y;
-
-	if (m.x + x < 0 || m.y + y < 0)
-		return false;
-	if (m.x + x >= s.m.w || m.y + y >= s.m.h)
-		return false;
-
-	if (m.x + x == o.x && m.y + y == o.y)
-		return false;
-
-	Tile t = s.m.m[(m.y + y) * s.m.w + m.x + x];
-	Tile mt = s.m.m[m.y * s.m.w + m.x];
-	
-	if (t == T_SOLID)
-		return false;
+	for (Button &B : s.m.B) {
+		DrawTile(SPR_HOLE, B.x * 16, B.y * 16);
+	}
+	EndSprites();
+	EndMode2D();
+	EndTextureMode();
+}
 
-	if (y < 0 && t == T_SOLIDBOTTOM)
-		return false;
-	if (y > 0 && mt == T_SOLIDBOTTOM)
-		return false;
-	if (y > 0 && t == T_SOLIDTOP)
-		return false;
-	if (y < 0 && mt == T_SOLIDTOP)
-		return false;
+// Doors animate on clocks of their own, started by the changes the rules
+// report as boxes come and go, so they don't hold up input.
+void ResetDoors() {
+	s.m.watch = true;
+	s.dt.assign(s.m.d.size(), 100);
+}
 
-	for (Door &d : s.m.d)
-		if (d.x == m.x + x && d.y == m.y + y && !DoorOpen(d))
-			return false;
+void UpdateDoors(float dt) {
+	for (float &t : s.dt)
+		t += dt;
+	for (const DoorChange &c : s.m.changes)
+		s.dt[c.door] = 0;
+	s.m.changes.clear();
+}
 
-	for (Box &b : s.m.b) {
-		if (b.x == m.x + x && b.y == m.y + y) {
-			if (TryMove<Box>(b, o, x, y)) {
-				Turn t;
-				t.type = TRN_BOX;
-				t.id = b.id;
-				t.fX = m.x + x;
-				t.fY = m.y + y;
-				t.tX = b.x;
-				t.tY = b.y;
-				s.m.t.push_back(t);
-			} else {
-				return false;
-			}
-		}
+void DrawDoor(int i) {
+	Door &d = s.m.d[i];
+	float T = AnimationTime(d.open ? ANIM_OPEN : ANIM_CLOSE);
+	float t = s.dt[i] + (float)s.lag;
+	if (t >= T) {
+		DrawTile(d.open ? SPR_OPEN : SPR_CLOSED, d.x * 16, d.y * 16);
+		return;
 	}
 
-	m.x += x;
-	m.y += y;
-	return true;
+	// The gate shrinks away into the opening, or grows back out of it.
+	float S = d.open ? 1 - t / T : t / T;
+	float o = (16 - 16 * S) / 2;
+	DrawTile(SPR_OPEN, d.x * 16, d.y * 16);
+	DrawTile(SPR_CLOSED, d.x * 16 + o, d.y * 16 + o, S);
 }
 
-bool /* success */ TryMoveA(int x, int y) {
-	int fX = s.a.x;
-	int fY = s.a.y;
-	int lX = s.a.lx;
-	int lY = s.a.ly;
-	if (TryMove<Player>(s.a, s.b, x, y)) {
-		Turn t;
-		t.type = TRN_PLAYER;
-		t.fX = fX;
-		t.fY = fY;
-		t.tX = s.a.x;
-		t.tY = s.a.y;
-		t.lX = lX;
-		t.lY = lY;
-		t.id = 0;
-		s.m.t.push_back(t);
-		return true;
-	}
-	return false;
+void LoadMap(const uint8_t *l /* map to load */) {
+	LoadMap(s, l);
+	ResetDoors();
+	PlayAnimation(ANIM_OPEN);
+	BakeBoard();
 }
 
-bool /* success */ TryMoveB(int x, int y) {
-	int fX = s.b.x;
-	int fY = s.b.y;
-	int lX = s.b.lx;
-	int lY = s.b.ly;
-	if (TryMove<Player>(s.b, s.a, x, y)) {
-		Turn t;
-		t.type = TRN_PLAYER;
-		t.fX = fX;
-		t.fY = fY;
-		t.tX = s.b.x;
-		t.tY = s.b.y;
-		t.lX = lX;
-		t.lY = lY;
-		t.id = 1;
-		s.m.t.push_back(t);
+bool /* game over */ LoadNextMap() {
+	PlaySound(SND_WIN);
+	s.in.clear(); // meant for the map that was just finished
+	if (++s.M >= mapCount) {
 		return true;
 	}
+	RecordMap(s.rec, s.M);
+	LoadMap(MapLevel(s.M));
+	s.par = MapPar(s.M);
 	return false;
 }
 
-bool AOverlaps(Tile t) {
-	return s.m.m[s.a.y * s.m.w + s.a.x] == t;
+void ReloadMap() {
+	s.tM -= s.m.M;
+	LoadMap(s, MapLevel(s.M));
+	ResetDoors();
+	PlayAnimation(ANIM_OPEN);
 }
 
-bool BOverlaps(Tile t) {
-	return s.m.m[s.b.y * s.m.w + s.b.x] == t;
+void Undo() {
+	s.tM -= Undo(s);
 }
 
+// For drawing: goes by da, not at.
 bool AnimationPlaying(Animation a) {
-	return s.A == a && s.at < AnimationTime();
+	return s.A == a && s.da < AnimationTime();
 }
 
-void EnactMove(bool a, bool b) {
-	if (!a && !b)
+void Step(int x, int y) {
+	if (!Step(s, x, y))
 		return;
 	s.tM++;
-	s.m.M++;
-	int i = 0;
-	for (const Turn &t : s.m.t) {
-		i++;
-		if (t.type == TRN_LABEL)
-			i = 0;
-	}
-	Turn t;
-	t.type = TRN_LABEL;
-	t.id = i;
-	s.m.t.push_back(t);
 	PlayAnimation(ANIM_TURN);
 	PlaySound(SND_FIRE);
-	SetSoundVolume(GetSound(SND_FIRE), 0.2f);
+}
+
+bool /* anything */ ReadInput() {
+	bool any = false;
+	for (int k; (k = GetKeyPressed());) {
+		any = true;
+		Action a;
+		switch (k) {
+		case KEY_UP:
+			a = ACT_UP;
+			break;
+		case KEY_DOWN:
+			a = ACT_DOWN;
+			break;
+		case KEY_LEFT:
+			a = ACT_LEFT;
+			break;
+		case KEY_RIGHT:
+			a = ACT_RIGHT;
+			break;
+		case KEY_U:
+			a = ACT_UNDO;
+			break;
+		case KEY_R:
+			a = ACT_RESET;
+			break;
+		case KEY_F:
+			s.hurry = !s.hurry;
+			continue;
+		default:
+			continue;
+		}
+		if (s.in.size() < INPUT_MAX)
+			s.in.push_back(Input{ .a = a, .t = s.clock });
+	}
+	return any;
+}
+
+// Animations run faster the more presses are backed up behind them.
+float AnimationSpeed() {
+	if (!s.hurry || s.in.empty() || s.clock - s.in.front().t < HURRY_AFTER)
+		return 1;
+	return 1 + 2 * (float)s.in.size();
+}
+
+void Apply(Action a) {
+	switch (a) {
+	case ACT_UP:
+		Record(s.rec, RE_UP);
+		Step(0, -1);
+		break;
+	case ACT_DOWN:
+		Record(s.rec, RE_DOWN);
+		Step(0, 1);
+		break;
+	case ACT_LEFT:
+		Record(s.rec, RE_LEFT);
+		Step(-1, 0);
+		break;
+	case ACT_RIGHT:
+		Record(s.rec, RE_RIGHT);
+		Step(1, 0);
+		break;
+	case ACT_UNDO:
+		Record(s.rec, RE_UNDO);
+		Undo();
+		break;
+	case ACT_RESET:
+		Record(s.rec, RE_RESET);
+		ReloadMap();
+		break;
+	}
 }
 
 int AnimLerp(int from, int to) {
-	return SInterp(from, to, s.at, AnimationTime());
+	return SInterp(from, to, s.da, AnimationTime());
 }
 
-void DrawPlayer(Player &p, Texture2D c, bool onFire) {
+void DrawPlayer(Player &p, Sprite c, bool onFire) {
 	if (AnimationPlaying(ANIM_FIRE)) {
 		float S = 1;
 
 		if (onFire)
-			S = 1 - (s.at / AnimationTime());
+			S = 1 - (s.da / AnimationTime());
 
 		float o = (16 - 16 * S) / 2;
-		DrawTextureEx(c, Vector2{ .x = p.x * 16 + o, .y = p.y * 16 + o }, 0, S, WHITE);
+		DrawTile(c, p.x * 16 + o, p.y * 16 + o, S);
 	}
 	else if (AnimationPlaying(ANIM_TURN)) {
-		DrawTexture(c, AnimLerp(p.lx * 16, p.x * 16), AnimLerp(p.ly * 16, p.y * 16), WHITE);
+		DrawTile(c, AnimLerp(p.lx * 16, p.x * 16), AnimLerp(p.ly * 16, p.y * 16));
+	}
+	else {
+		DrawTile(c, p.x * 16, p.y * 16);
+	}
+}
+
+// One step of the logic clock. Everything that changes the game happens in
+// here, at a fixed rate, so it plays out the same at any frame rate.
+bool /* game over */ Tick(float dt) {
+	s.clock += dt;
+	if (s.at >= AnimationTime()) {
+		s.a.w = AOverlaps(s, T_GOALA);
+		s.b.w = BOverlaps(s, T_GOALB);
+
+		if (OnFire(s)) {
+			PlayAnimation(ANIM_FIRE);
+		}
+
+		if (s.a.w && s.b.w) {
+			if (LoadNextMap())
+				return true;
+		}
+
+		for (Box &b : s.m.b) {
+			b.lx = b.x;
+			b.ly = b.y;
+		}
+
+		// Fire and the next map both start an animation of their own.
+		if (s.at >= AnimationTime() && !s.in.empty()) {
+			Action a = s.in.front().a;
+			s.in.pop_front();
+			Apply(a);
+		}
+		s.settled = s.at >= AnimationTime() && s.in.empty();
 	}
 	else {
-		DrawTexture(c, p.x * 16, p.y * 16, WHITE);
+		s.settled = false;
+		s.at += dt * AnimationSpeed();
+
+		if (s.at >= AnimationTime()) {
+			// animation just finished
+			if (s.A == ANIM_FIRE) {
+				Record(s.rec, RE_UNDO);
+				Undo();
+			}
+		}
 	}
+
+	UpdateDoors(dt);
+	return false;
+}
+
+// True when another frame would look exactly like the last one.
+bool Idle() {
+	if (!s.settled || !s.in.empty())
+		return false;
+	for (size_t i = 0; i < s.dt.size(); i++)
+		if (s.dt[i] < AnimationTime(s.m.d[i].open ? ANIM_OPEN : ANIM_CLOSE))
+			return false;
+	return true;
 }
 
 bool TrijamRunGame() {
-	int fadein = 0;
+	float fadein = 0; // kept fractional: a fast frame moves it less than a pixel
 	bool restart = false;
 	s = {};
 	s.t.Load();
 	LoadNextMap();
+	s.last = GetTime();
 
 	PlaySound(SND_START);
+	PlayMusic("snd/music.wav", 0.5f);
 	//DoFadeOutAnimation();
 
 	while (!WindowShouldClose()) {
-		PlaySound(SND_MUSIC);
-
-		if (s.at >= AnimationTime()) {
-			if (IsKeyPressed(KEY_R))
-				ReloadMap();
-			if (IsKeyPressed(KEY_U))
-				Undo();
-
-			s.a.w = AOverlaps(T_GOALA);
-			s.b.w = BOverlaps(T_GOALB);
-
-			if (AOverlaps(T_FIRE)) {
-				PlayAnimation(ANIM_FIRE);
-			}
-			if (BOverlaps(T_FIRE)) {
-				PlayAnimation(ANIM_FIRE);
-			}
-
-			if (s.a.w && s.b.w) {
-				if (LoadNextMap()) {
-					restart = GameOver();
-					goto END;
-				}
-			}
-
-			for (Box &b : s.m.b) {
-				b.lx = b.x;
-				b.ly = b.y;
-			}
+		PollAssets();
+		if (s.t.Refresh())
+			BakeBoard();
+
+		// Sleep through the idle stretches instead of drawing the same frame
+		// over and over; a press, a resize or anything else wakes it. Hot
+		// reloading needs the loop running to notice files change.
+		if (ReadInput() || IsWindowResized())
+			s.shown = false;
+		if (s.shown && Idle() && fadein >= GetScreenWidth() && !HotReloading() && WaitForEvents()) {
+			s.last = GetTime(); // the wait isn't game time
+			s.shown = false;
+			ReadInput();
+		}
 
-			if (IsKeyPressed(KEY_UP)) {
-				EnactMove(TryMoveA(0, -1), TryMoveB(0, 1));
-			}
-			if (IsKeyPressed(KEY_DOWN)) {
-				EnactMove(TryMoveA(0, 1), TryMoveB(0, -1));
+		// Run as many ticks as the frame took, and draw the animations as far
+		// along as they'd be between the last one and the next.
+		double step = 1.0 / tickRate;
+		double now = GetTime();
+		s.lag += now - s.last;
+		s.last = now;
+		for (int n = 0; s.lag >= step; n++) {
+			if (n == MAX_TICKS) {
+				s.lag = 0; // too far behind to catch up; let it go
+				break;
 			}
-			if (IsKeyPressed(KEY_LEFT)) {
-				EnactMove(TryMoveA(-1, 0), TryMoveB(1, 0));
+			s.lag -= step;
+			if (Tick((float)step)) {
+				restart = GameOver();
+				goto END;
 			}
-			if (IsKeyPressed(KEY_RIGHT)) {
-				EnactMove(TryMoveA(1, 0), TryMoveB(-1, 0));
-			}
-
 		}
-		else {
-			s.at += GetFrameTime();
-
-			if (s.at >= AnimationTime()) {
-				// animation just finished
-				if (s.A == ANIM_FIRE)
-					Undo();
-			}
+		s.da = s.at < AnimationTime() ? Min(s.at + (float)s.lag * AnimationSpeed(), AnimationTime()) : s.at;
+
+		// The board is drawn 1:1 into s.view and blown up once at the end, so
+		// sprites fill zoom^2 fewer pixels and the zoom is one scaled quad.
+		int z = Zoom();
+		int vw = (GetScreenWidth() + z - 1) / z;
+		int vh = (GetScreenHeight() + z - 1) / z;
+		if (s.view.texture.width != vw || s.view.texture.height != vh) {
+			if (s.view.id)
+				UnloadRenderTexture(s.view);
+			s.view = LoadRenderTexture(vw, vh);
+			SetTextureFilter(s.view.texture, TEXTURE_FILTER_POINT);
+			if (Max(vw - s.m.w * 16, vh - s.m.h * 16) / 2 > s.border * 16)
+				BakeBoard();
 		}
 
-		BeginDrawing();
+		BeginTextureMode(s.view);
 
 		ClearBackground(BLACK);
 
 		Camera2D c{ 0 };
 		{
-			int w = s.m.w * 16;
-			int h = s.m.h * 16;
-			float wz = SCRWID / (w + 16);
-			float hz = SCRHEI / (h + 16);
-			c.zoom = floor(Min(wz, hz));
-			c.target.x = w / 2;
-			c.target.y = h / 2;
-			c.offset.x = SCRWID / 2;
-			c.offset.y = SCRHEI / 2;
+			c.zoom = 1;
+			c.target.x = s.m.w * 16 / 2;
+			c.target.y = s.m.h * 16 / 2;
+			c.offset.x = vw / 2;
+			c.offset.y = vh / 2;
 			c.rotation = 0;
 		}
 
 		BeginMode2D(c);
 
-		for (int y = -5; y < s.m.h + 5; y++) {
-			for (int x = -5; x < s.m.w + 5; x++) {
-				if (x >= 0 && x < s.m.w
-					&& y >= 0 && y < s.m.h)
-					continue;
-				DrawTexture(s.t.wall, x * 16, y * 16, WHITE);
-			}
-		}
+		DrawTextureRec(
+			s.board.texture,
+			Rectangle{ 0, 0, (float)s.board.texture.width, -(float)s.board.texture.height },
+			Vector2{ -s.border * 16.f, -s.border * 16.f }, WHITE);
 
-		for (int y = 0; y < s.m.h; y++) {
-			for (int x = 0; x < s.m.w; x++) {
-				int i = y * s.m.w + x;
-				Tile t = s.m.m[i];
-				switch (t) {
-				case T_AIR:
-					DrawTexture(s.t.bg, x * 16, y * 16, WHITE);
-					break;
-				case T_SOLID:
-					DrawTexture(s.t.wall, x * 16, y * 16, WHITE);
-					break;
-				case T_GOALA:
-					DrawTexture(s.t.bg, x * 16, y * 16, WHITE);
-					DrawTexture(s.t.p1f, x * 16, y * 16, WHITE);
-					break;
-				case T_GOALB:
-					DrawTexture(s.t.bg, x * 16, y * 16, WHITE);
-					DrawTexture(s.t.p2f, x * 16, y * 16, WHITE);
-					break;
-				case T_SOLIDBOTTOM:
-					DrawTexture(s.t.bg, x * 16, y * 16, WHITE);
-					DrawTexture(s.t.wallb, x * 16, y * 16, WHITE);
-					break;
-				case T_SOLIDTOP:
-					DrawTexture(s.t.bg, x * 16, y * 16, WHITE);
-					DrawTexture(s.t.wallt, x * 16, y * 16, WHITE);
-					break;
-				case T_FIRE:
-					DrawTexture(s.t.death, x * 16, y * 16, WHITE);
-				}
-			}
-		}
+		BeginSprites(s.t.atlas);
 
-		for (Button &B : s.m.B) {
-			DrawTexture(s.t.hole, B.x * 16, B.y * 16, WHITE);
-		}
 		for (Box &b : s.m.b) {
 			if (AnimationPlaying(ANIM_TURN)) {
-				DrawTexture(
-					s.t.box,
+				DrawTile(
+					SPR_BOX,
 					AnimLerp(b.lx * 16, b.x * 16),
-					AnimLerp(b.ly * 16, b.y * 16), WHITE);
+					AnimLerp(b.ly * 16, b.y * 16));
 			}
 			else {
-				DrawTexture(s.t.box, b.x * 16, b.y * 16, WHITE);
+				DrawTile(SPR_BOX, b.x * 16, b.y * 16);
 			}
 		}
 
-		DrawPlayer(s.a, s.t.p1, AOverlaps(T_FIRE));
-		DrawPlayer(s.b, s.t.p2, BOverlaps(T_FIRE));
+		DrawPlayer(s.a, SPR_P1, AOverlaps(s, T_FIRE));
+		DrawPlayer(s.b, SPR_P2, BOverlaps(s, T_FIRE));
 
-		for (Door &d : s.m.d) {
-			DrawTexture(DoorOpen(d) ? s.t.open : s.t.closed, d.x * 16, d.y * 16, WHITE);
+		for (int i = 0; i < (int)s.m.d.size(); i++) {
+			DrawDoor(i);
 		}
 
 		//DrawParticles();
 
+		EndSprites();
 		EndMode2D();
 
+		EndTextureMode();
+
+		BeginDrawing();
+
+		ClearBackground(BLACK);
+
+		DrawTexturePro(
+			s.view.texture,
+			Rectangle{ 0, 0, (float)vw, -(float)vh },
+			Rectangle{ (float)(GetScreenWidth() - vw * z) / 2, (float)(GetScreenHeight() - vh * z) / 2, (float)vw * z, (float)vh * z },
+			Vector2{ 0, 0 }, 0, WHITE);
+
 		if (AnimationPlaying(ANIM_OPEN)) {
-			DrawCircle(SCRWID / 2, SCRHEI / 2, 800 * (1 - (s.at / AnimationTime())), BLACK);
+			DrawCircle(GetScreenWidth() / 2, GetScreenHeight() / 2, Max(GetScreenWidth(), GetScreenHeight()) * (1 - (s.da / AnimationTime())), BLACK);
 		}
 
 		{
-			const char *t = TextFormat("%d moves this map\n%d moves in total", s.m.M, s.tM);
+			const char *t = s.par < 0 ? TextFormat("%d moves this map\n%d moves in total", s.m.M, s.tM)
+				: TextFormat("%d moves this map (par %d)\n%d moves in total", s.m.M, s.par, s.tM);
 			DrawText(t, 7, 7, 20, BLACK);
 			DrawText(t, 5, 5, 20, WHITE);
 
-			int w = MeasureText(s.m.n, 20);
-			DrawText(s.m.n, SCRWID - 3 - w, 7, 20, BLACK);
-			DrawText(s.m.n, SCRWID - 5 - w, 5, 20, WHITE);
+			int w = MeasureText(s.m.n.c_str(), 20);
+			DrawText(s.m.n.c_str(), GetScreenWidth() - 3 - w, 7, 20, BLACK);
+			DrawText(s.m.n.c_str(), GetScreenWidth() - 5 - w, 5, 20, WHITE);
 		}
 
-		DrawKeybindBar("[Up] [Down] [Left] [Right]", "[U] Undo [R] Reset");
+		DrawKeybindBar("[Up] [Down] [Left] [Right]", s.hurry ? "[U] Undo [R] Reset [F] Hurry: on" : "[U] Undo [R] Reset [F] Hurry: off");
 
 		DoFadeInAnimation(fadein);
 
 		EndDrawing();
+		s.shown = Idle();
 	}
 
 END:
 
 	SaveGlobState();
+	if (recordTo) {
+		FinishReplay(s.rec, s);
+		if (!SaveFileData(recordTo, s.rec.e.data(), (int)s.rec.e.size()))
+			TraceLog(LOG_WARNING, "REPLAY: Couldn't write %s", recordTo);
+	}
 
-	StopSound(SND_MUSIC);
+	StopMusic();
+	UnloadRenderTexture(s.board);
+	UnloadRenderTexture(s.view);
 	s.t.Unload();
 
 	return restart;
@@ -0,0 +1,272 @@
+#include "global.h"
+#include "pack.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum AssetKind {
+	ASSET_IMAGE,
+	ASSET_SOUND,
+	ASSET_ALIAS
+};
+
+struct Asset {
+	std::string path;
+	AssetKind kind;
+	AssetID of = -1; // what an alias plays
+	int refs = 0;
+	int version = 0;
+	bool packed = false; // points into the pack, so there's nothing to free
+	long mtime = 0;
+	Image img{};
+	Wave wave{}; // decoded, not yet handed to the audio device
+	Sound snd{};
+	double ms = 0; // time it took to decode
+};
+
+static std::vector<Asset> assets;
+static std::vector<Asset> queued;
+static bool hotReload = false;
+static double lastPoll = 0;
+
+// The half of loading that's safe off the main thread.
+static void Decode(Asset &a) {
+	auto t = std::chrono::steady_clock::now();
+	// Hot reloading wants the loose files that are being edited.
+	a.packed = false;
+	switch (a.kind) {
+	case ASSET_IMAGE:
+		a.packed = !hotReload && PackImage(a.path.c_str(), a.img);
+		if (!a.packed)
+			a.img = LoadImage(a.path.c_str());
+		break;
+	case ASSET_SOUND:
+		a.packed = !hotReload && PackWave(a.path.c_str(), a.wave);
+		if (!a.packed)
+			a.wave = LoadWave(a.path.c_str());
+		break;
+	case ASSET_ALIAS:
+		break;
+	}
+	a.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+}
+
+// The half that isn't.
+static void Finish(Asset &a) {
+	switch (a.kind) {
+	case ASSET_IMAGE:
+		break;
+	case ASSET_SOUND:
+		a.snd = LoadSoundFromWave(a.wave);
+		if (!a.packed)
+			UnloadWave(a.wave);
+		a.wave = {};
+		break;
+	case ASSET_ALIAS:
+		a.snd = LoadSoundAlias(assets[a.of].snd);
+		break;
+	}
+	a.mtime = GetFileModTime(a.path.c_str());
+}
+
+static void LoadAsset(Asset &a) {
+	Decode(a);
+	Finish(a);
+}
+
+static void FreeAsset(Asset &a) {
+	switch (a.kind) {
+	case ASSET_IMAGE:
+		if (!a.packed)
+			UnloadImage(a.img);
+		break;
+	case ASSET_SOUND:
+		StopSound(a.snd);
+		UnloadSound(a.snd);
+		break;
+	case ASSET_ALIAS:
+		StopSound(a.snd);
+		UnloadSoundAlias(a.snd);
+		break;
+	}
+}
+
+static AssetID Acquire(const char *path, AssetKind kind) {
+	for (int i = 0; i < (int)assets.size(); i++) {
+		if (assets[i].kind == kind && assets[i].path == path) {
+			assets[i].refs++;
+			return i;
+		}
+	}
+
+	Asset a;
+	a.path = path;
+	a.kind = kind;
+	a.refs = 1;
+	LoadAsset(a);
+	assets.push_back(a);
+	return (AssetID)assets.size() - 1;
+}
+
+AssetID AcquireImage(const char *path) {
+	return Acquire(path, ASSET_IMAGE);
+}
+
+AssetID AcquireSound(const char *path) {
+	return Acquire(path, ASSET_SOUND);
+}
+
+AssetID AcquireSoundAlias(AssetID of) {
+	Asset a;
+	a.path = assets[of].path;
+	a.kind = ASSET_ALIAS;
+	a.of = of;
+	a.refs = 1;
+	LoadAsset(a);
+	assets[of].refs++;
+	assets.push_back(a);
+	return (AssetID)assets.size() - 1;
+}
+
+static void Queue(const char *path, AssetKind kind) {
+	for (const Asset &a : assets)
+		if (a.kind == kind && a.path == path)
+			return;
+	for (const Asset &a : queued)
+		if (a.kind == kind && a.path == path)
+			return;
+	Asset a;
+	a.path = path;
+	a.kind = kind;
+	queued.push_back(a);
+}
+
+void QueueImage(const char *path) {
+	Queue(path, ASSET_IMAGE);
+}
+
+void QueueSound(const char *path) {
+	Queue(path, ASSET_SOUND);
+}
+
+void LoadQueuedAssets() {
+	if (queued.empty())
+		return;
+	auto t = std::chrono::steady_clock::now();
+
+	// Decoding is all CPU, so it's spread over every core. The device side,
+	// and the asset list itself, stay on this thread.
+	std::atomic<size_t> next = 0;
+	auto work = [&]() {
+		for (size_t i; (i = next++) < queued.size();)
+			Decode(queued[i]);
+	};
+#ifdef PLATFORM_WEB // no threads in the web build
+	work();
+#else
+	std::vector<std::thread> pool;
+	size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), queued.size());
+	for (size_t i = 1; i < threads; i++)
+		pool.emplace_back(work);
+	work();
+	for (std::thread &th : pool)
+		th.join();
+#endif
+
+	for (Asset &a : queued) {
+		Finish(a);
+		TraceLog(LOG_INFO, "ASSETS: Decoded %s in %.1f ms", a.path.c_str(), a.ms);
+		assets.push_back(a); // no refs until someone acquires it
+	}
+	TraceLog(LOG_INFO, "ASSETS: Loaded %d files in %.1f ms", (int)queued.size(), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count());
+	queued.clear();
+}
+
+bool /* ok */ PackQueuedAssets(const char *path) {
+	std::vector<PackItem> items;
+	for (Asset &a : queued) {
+		Decode(a);
+		// Images go in the way the GPU takes them. Sounds go in as raylib
+		// decodes them, 16-bit at the channel count they were recorded with;
+		// LoadSoundFromWave takes them to 32-bit stereo as they're loaded,
+		// and storing them that way would make mono ones four times the size.
+		if (a.kind == ASSET_IMAGE)
+			ImageFormat(&a.img, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+		items.push_back(PackItem{ .path = a.path.c_str(), .wave = a.kind == ASSET_SOUND, .img = a.img, .wav = a.wave });
+	}
+
+	bool ok = WritePack(path, items);
+	for (Asset &a : queued) {
+		if (a.kind == ASSET_IMAGE)
+			UnloadImage(a.img);
+		else
+			UnloadWave(a.wave);
+	}
+	TraceLog(ok ? LOG_INFO : LOG_WARNING, "ASSETS: %s %s with %d files", ok ? "Wrote" : "Couldn't write", path, (int)queued.size());
+	queued.clear();
+	return ok;
+}
+
+// Nothing is freed when the count hits zero; the next run will want it
+// again. UnloadAssets() frees everything on the way out.
+void ReleaseAsset(AssetID id) {
+	if (assets[id].refs > 0)
+		assets[id].refs--;
+}
+
+Image AssetImage(AssetID id) {
+	return assets[id].img;
+}
+
+Sound AssetSound(AssetID id) {
+	return assets[id].snd;
+}
+
+int AssetVersion(AssetID id) {
+	return assets[id].version;
+}
+
+void EnableHotReload(bool on) {
+	hotReload = on;
+}
+
+bool HotReloading() {
+	return hotReload;
+}
+
+void PollAssets() {
+	if (!hotReload || GetTime() - lastPoll < 0.5)
+		return;
+	lastPoll = GetTime();
+
+	for (int i = 0; i < (int)assets.size(); i++) {
+		Asset &a = assets[i];
+		if (a.kind == ASSET_ALIAS || GetFileModTime(a.path.c_str()) == a.mtime)
+			continue;
+
+		// Aliases point into the samples they share, so they go first and
+		// come back after.
+		for (Asset &b : assets)
+			if (b.kind == ASSET_ALIAS && b.of == i)
+				FreeAsset(b);
+		FreeAsset(a);
+		LoadAsset(a);
+		a.version++;
+		for (Asset &b : assets) {
+			if (b.kind == ASSET_ALIAS && b.of == i) {
+				LoadAsset(b);
+				b.version++;
+			}
+		}
+		TraceLog(LOG_INFO, "ASSETS: Reloaded %s", a.path.c_str());
+	}
+}
+
+void UnloadAssets() {
+	for (int i = (int)assets.size() - 1; i >= 0; i--)
+		FreeAsset(assets[i]);
+	assets.clear();
+}
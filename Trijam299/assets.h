@@ -0,0 +1,30 @@
+#pragma once
+
+// Everything loaded off disk, kept for the life of the process so restarting
+// a run doesn't touch the disk again. Asking for the same path twice gives
+// the same handle back and bumps its count.
+
+typedef int AssetID;
+
+AssetID AcquireImage(const char *path);
+AssetID AcquireSound(const char *path);
+AssetID AcquireSoundAlias(AssetID of); // a separate voice onto the same samples
+void ReleaseAsset(AssetID id);
+
+// Files wanted soon can be queued up and decoded all at once, on every core,
+// so the later Acquire calls find them already loaded.
+void QueueImage(const char *path);
+void QueueSound(const char *path);
+void LoadQueuedAssets();
+// Writes the queue to a pack (see pack.h) instead of loading it.
+bool /* ok */ PackQueuedAssets(const char *path);
+
+Image AssetImage(AssetID id);
+Sound AssetSound(AssetID id);
+int AssetVersion(AssetID id); // goes up every time the file is reloaded
+
+// Watches the files behind every asset and reloads the ones that change.
+void EnableHotReload(bool on);
+bool HotReloading();
+void PollAssets();
+void UnloadAssets();
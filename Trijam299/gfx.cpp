@@ -2,36 +2,81 @@
 
 void DrawKeybindBar(const char *left, const char *right, bool bg) {
 	if (bg)
-		DrawRectangle(0, SCRHEI - 30, SCRWID, 30, Fade(BLACK, 0.7f));
-	DrawLine(0, SCRHEI - 31, SCRWID, SCRHEI - 31, WHITE); // I dislike the number "31" here, but it is correct. Sad.
-	DrawText(left, 10, SCRHEI - 25, 20, WHITE);
+		DrawRectangle(0, GetScreenHeight() - 30, GetScreenWidth(), 30, Fade(BLACK, 0.7f));
+	DrawLine(0, GetScreenHeight() - 31, GetScreenWidth(), GetScreenHeight() - 31, WHITE); // I dislike the number "31" here, but it is correct. Sad.
+	DrawText(left, 10, GetScreenHeight() - 25, 20, WHITE);
 	int rlen = MeasureText(right, 20);
-	DrawText(right, SCRWID - 10 - rlen, SCRHEI - 25, 20, WHITE);
+	DrawText(right, GetScreenWidth() - 10 - rlen, GetScreenHeight() - 25, 20, WHITE);
+}
+
+bool /* waited */ WaitForEvents() {
+#ifdef PLATFORM_WEB
+	return false;
+#else
+	EnableEventWaiting();
+	PollInputEvents();
+	DisableEventWaiting();
+	return true;
+#endif
 }
 
 void DoFadeOutAnimation() {
 	int top = 0;
 
-	while ((top += 80) <= SCRWID) {
-		float t = ((float)top) / (float)SCRWID;
+	while ((top += 80) <= GetScreenWidth()) {
+		float t = ((float)top) / (float)GetScreenWidth();
 		t *= t;
-		t *= SCRWID;
+		t *= GetScreenWidth();
 
 		BeginDrawing();
 
-		DrawRectangle(0, 0, t, SCRHEI, BLUE);
+		DrawRectangle(0, 0, t, GetScreenHeight(), BLUE);
 
 		EndDrawing();
 	}
 }
 
-void DoFadeInAnimation(int &top) {
-	if (top < SCRWID) {
-		top += 60;
-		float t = ((float)top) / (float)SCRWID;
+void DoFadeInAnimation(float &top) {
+	if (top < GetScreenWidth()) {
+		top += 1800 * GetFrameTime(); // was 60 a frame at 30 FPS
+		float t = top / (float)GetScreenWidth();
 		t *= t;
-		t *= SCRWID;
+		t *= GetScreenWidth();
 
-		DrawRectangle(t, 0, SCRWID, SCRHEI, BLUE);
+		DrawRectangle(t, 0, GetScreenWidth(), GetScreenHeight(), BLUE);
 	}
+}
+
+static Texture2D spriteAtlas;
+
+void BeginSprites(Texture2D atlas) {
+	spriteAtlas = atlas;
+	rlSetTexture(atlas.id);
+	rlBegin(RL_QUADS);
+}
+
+void DrawSprite(Rectangle src, float x, float y, float scale, Color tint) {
+	float w = src.width * scale;
+	float h = src.height * scale;
+	float u0 = src.x / spriteAtlas.width;
+	float v0 = src.y / spriteAtlas.height;
+	float u1 = (src.x + src.width) / spriteAtlas.width;
+	float v1 = (src.y + src.height) / spriteAtlas.height;
+
+	rlCheckRenderBatchLimit(4); // flushes and carries on with the same texture if full
+	rlColor4ub(tint.r, tint.g, tint.b, tint.a);
+	rlNormal3f(0, 0, 1);
+	rlTexCoord2f(u0, v0);
+	rlVertex2f(x, y);
+	rlTexCoord2f(u0, v1);
+	rlVertex2f(x, y + h);
+	rlTexCoord2f(u1, v1);
+	rlVertex2f(x + w, y + h);
+	rlTexCoord2f(u1, v0);
+	rlVertex2f(x + w, y);
+}
+
+void EndSprites() {
+	rlEnd();
+	rlSetTexture(0);
 }
\ No newline at end of file
@@ -2,4 +2,11 @@
 
 void DrawKeybindBar(const char *left, const char *right, bool bg = true);
 void DoFadeOutAnimation();
-void DoFadeInAnimation(int &top);
\ No newline at end of file
+void DoFadeInAnimation(float &top);
+// Sleeps until the OS has input for the window. False on the web, where the
+// browser runs the loop and waiting would hang it.
+bool /* waited */ WaitForEvents();
+// Sprites off one atlas, pushed straight into rlgl as a single run of quads.
+void BeginSprites(Texture2D atlas);
+void DrawSprite(Rectangle src, float x, float y, float scale = 1, Color tint = WHITE);
+void EndSprites();
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+// Starting window size. It can be resized after, so draw against GetScreenWidth()/GetScreenHeight().
 #define SCRWID 800
 #define SCRHEI 600
 
@@ -7,7 +8,9 @@
 #include <rlgl.h>
 #include <cmath>
 #include "version.h"
+#include "assets.h"
 #include "sound.h"
+#include "music.h"
 #include "gfx.h"
 #include "helpers.h"
 #include "globstate.h"
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "mapfile.h"
+
+#if defined(PLATFORM_WEB)
+#include <cstdio>
+#include <cstdlib>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const void *MapFile(const char *path, size_t &size) {
+#if defined(PLATFORM_WEB)
+	// Nothing to map on the web: preloaded files are already in memory, so
+	// it's read into a copy.
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return nullptr;
+	fseek(f, 0, SEEK_END);
+	size = (size_t)ftell(f);
+	fseek(f, 0, SEEK_SET);
+	void *p = malloc(size);
+	if (p && fread(p, 1, size, f) != size) {
+		free(p);
+		p = nullptr;
+	}
+	fclose(f);
+	return p;
+#elif defined(_WIN32)
+	HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (f == INVALID_HANDLE_VALUE)
+		return nullptr;
+	LARGE_INTEGER n;
+	if (!GetFileSizeEx(f, &n) || !n.QuadPart) {
+		CloseHandle(f);
+		return nullptr;
+	}
+	size = (size_t)n.QuadPart;
+	HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(f);
+	if (!m)
+		return nullptr;
+	const void *p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(m); // the view keeps the mapping alive
+	return p;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+	struct stat st;
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		return nullptr;
+	}
+	size = (size_t)st.st_size;
+	void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); // the mapping keeps the file open
+	return p == MAP_FAILED ? nullptr : p;
+#endif
+}
+
+void UnmapFile(const void *p, size_t size) {
+	if (!p)
+		return;
+#if defined(PLATFORM_WEB)
+	free((void *)p);
+#elif defined(_WIN32)
+	UnmapViewOfFile(p);
+#else
+	munmap((void *)p, size);
+#endif
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// A whole file mapped read-only into memory, so every copy of the game
+// running shares the same pages. Kept apart from raylib: windows.h and
+// raylib.h both want CloseWindow and Rectangle.
+
+#include <cstddef>
+
+const void *MapFile(const char *path, size_t &size);
+void UnmapFile(const void *p, size_t size);
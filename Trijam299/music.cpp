@@ -0,0 +1,312 @@
+#include "global.h"
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define MUSIC_RATE 48000
+#define MUSIC_CHANNELS 2
+#define MUSIC_CHUNK 1024 // frames read from disk at a time
+#define MUSIC_RING 16384 // frames read ahead of the mixer, about a third of a second; a power of two
+
+// A 16-bit PCM .wav, open at its samples.
+struct Wav {
+	FILE *f = nullptr;
+	long data = 0; // where the samples start in the file
+	uint32_t frames = 0;
+	uint32_t pos = 0;
+	int channels = 0;
+};
+
+// The reader thread reads ahead into the ring, and the audio callback only
+// ever copies out of it: a slow disk shows up as a gap in the music rather
+// than a stall in every other sound.
+struct Track {
+	Wav w; // the reader's alone
+
+	// Under lock.
+	bool on = false; // being mixed; the mixer clears it once faded out
+	float gain = 0;
+	float target = 0;
+	float step = 0; // gain change per frame
+
+	// Stereo frames; the reader writes ahead of rd and the mixer reads up to wr.
+	int16_t ring[MUSIC_RING * MUSIC_CHANNELS];
+	std::atomic<uint32_t> wr = 0;
+	std::atomic<uint32_t> rd = 0;
+};
+
+static AudioStream stream;
+static std::mutex lock; // never held across a read
+static std::condition_variable wake;
+static std::thread reader;
+static Track tracks[2];
+static int cur = 0; // the one playing; the other's fading out, or free
+static std::string wanted; // asked for and not started yet
+static float wantedFade = 0;
+static bool asked = false;
+static bool quit = false;
+
+static void CloseWav(Wav &w) {
+	if (w.f)
+		fclose(w.f);
+	w = {};
+}
+
+static bool /* ok */ OpenWav(Wav &w, const char *path) {
+	FILE *f = nullptr;
+#ifdef _MSC_VER
+	fopen_s(&f, path, "rb");
+#else
+	f = fopen(path, "rb");
+#endif
+	if (!f)
+		return false;
+
+	char id[4];
+	uint32_t size;
+	uint16_t format = 0;
+	uint16_t bits = 0;
+	uint32_t rate = 0;
+	if (fread(id, 4, 1, f) != 1 || memcmp(id, "RIFF", 4) || fseek(f, 4, SEEK_CUR) || fread(id, 4, 1, f) != 1 || memcmp(id, "WAVE", 4)) {
+		fclose(f);
+		return false;
+	}
+
+	w = {};
+	while (fread(id, 4, 1, f) == 1 && fread(&size, 4, 1, f) == 1) {
+		if (!memcmp(id, "fmt ", 4)) {
+			uint16_t channels;
+			fread(&format, 2, 1, f);
+			fread(&channels, 2, 1, f);
+			fread(&rate, 4, 1, f);
+			fseek(f, 6, SEEK_CUR);
+			fread(&bits, 2, 1, f);
+			fseek(f, size - 16, SEEK_CUR);
+			w.channels = channels;
+		}
+		else if (!memcmp(id, "data", 4)) {
+			w.data = ftell(f);
+			break;
+		}
+		else {
+			fseek(f, size + (size & 1), SEEK_CUR);
+		}
+	}
+
+	if (format != 1 || bits != 16 || rate != MUSIC_RATE || w.channels < 1 || w.channels > 2 || !w.data) {
+		TraceLog(LOG_WARNING, "MUSIC: %s isn't 16-bit PCM at %d Hz", path, MUSIC_RATE);
+		fclose(f);
+		return false;
+	}
+	w.f = f;
+	w.frames = size / (2 * w.channels);
+	if (!w.frames) {
+		CloseWav(w);
+		return false;
+	}
+	return true;
+}
+
+static void FadeTo(Track &t, float target, float fade) {
+	t.target = target;
+	if (fade <= 0) {
+		t.gain = target;
+		t.step = 0;
+	}
+	else {
+		t.step = (target - t.gain) / (fade * MUSIC_RATE);
+	}
+}
+
+// Reads t's file into its ring until the ring is full, wrapping back to the
+// start for the loop.
+static void TopUp(Track &t) {
+	Wav &w = t.w;
+	int16_t in[MUSIC_CHUNK * 2];
+	uint32_t wr = t.wr.load(std::memory_order_relaxed);
+	while (w.f) {
+		unsigned n = MUSIC_RING - (wr - t.rd.load(std::memory_order_acquire));
+		if (!n)
+			break;
+		if (n > MUSIC_CHUNK)
+			n = MUSIC_CHUNK;
+		if (n > MUSIC_RING - wr % MUSIC_RING)
+			n = MUSIC_RING - wr % MUSIC_RING;
+		if (n > w.frames - w.pos)
+			n = w.frames - w.pos;
+
+		n = (unsigned)fread(in, 2 * w.channels, n, w.f);
+		if (!n && !w.pos) {
+			CloseWav(w); // can't read it at all
+			break;
+		}
+		int16_t *out = &t.ring[wr % MUSIC_RING * MUSIC_CHANNELS];
+		for (unsigned i = 0; i < n; i++) {
+			out[i * 2] = in[i * w.channels];
+			out[i * 2 + 1] = in[i * w.channels + w.channels - 1];
+		}
+		wr += n;
+		t.wr.store(wr, std::memory_order_release);
+		w.pos += n;
+
+		if (w.pos >= w.frames || n == 0) {
+			w.pos = 0;
+			fseek(w.f, w.data, SEEK_SET);
+		}
+	}
+}
+
+// Everything that touches a file: starting what was asked for, closing what
+// has faded out, and reading ahead. The lock is let go for each of them.
+static void Fill() {
+	std::unique_lock<std::mutex> g(lock);
+	bool start = asked;
+	std::string path = wanted;
+	float fade = wantedFade;
+	asked = false;
+	int n = cur ^ 1;
+	g.unlock();
+
+	Wav w;
+	if (start && OpenWav(w, path.c_str())) {
+		Track &t = tracks[n];
+		g.lock();
+		t.on = false; // cut it if it's still fading out
+		g.unlock();
+		CloseWav(t.w);
+		t.w = w;
+		t.wr = 0;
+		t.rd = 0;
+		TopUp(t);
+
+		g.lock();
+		FadeTo(tracks[cur], 0, fade);
+		if (tracks[cur].gain == 0)
+			tracks[cur].on = false;
+		t.gain = fade > 0 ? 0 : 1;
+		FadeTo(t, 1, fade);
+		t.on = true;
+		cur = n;
+		g.unlock();
+	}
+
+	for (Track &t : tracks) {
+		g.lock();
+		bool on = t.on;
+		g.unlock();
+		if (on)
+			TopUp(t);
+		else
+			CloseWav(t.w);
+	}
+}
+
+static void Read() {
+	std::unique_lock<std::mutex> g(lock);
+	while (!quit) {
+		g.unlock();
+		Fill();
+		g.lock();
+		// A third of a second read ahead leaves plenty of slack.
+		wake.wait_for(g, std::chrono::milliseconds(10), [] { return quit || asked; });
+	}
+}
+
+// Adds up to `frames` frames of t into out. If the reader's fallen behind,
+// the rest is left silent.
+static void MixTrack(Track &t, float *out, unsigned frames) {
+	if (!t.on)
+		return;
+	uint32_t rd = t.rd.load(std::memory_order_relaxed);
+	unsigned n = t.wr.load(std::memory_order_acquire) - rd;
+	if (n > frames)
+		n = frames;
+	for (unsigned i = 0; i < n; i++) {
+		const int16_t *in = &t.ring[(rd + i) % MUSIC_RING * MUSIC_CHANNELS];
+		out[0] += in[0] / 32768.f * t.gain;
+		out[1] += in[1] / 32768.f * t.gain;
+		out += 2;
+
+		if (t.gain != t.target) {
+			t.gain += t.step;
+			if ((t.step > 0 && t.gain >= t.target) || (t.step < 0 && t.gain <= t.target))
+				t.gain = t.target;
+		}
+	}
+	t.rd.store(rd + n, std::memory_order_release);
+
+	if (t.target == 0 && t.gain == 0)
+		t.on = false;
+}
+
+static void MusicCallback(void *buffer, unsigned int frames) {
+#ifdef PLATFORM_WEB
+	Fill(); // no threads, and the files are in memory anyway
+#endif
+	float mix[MUSIC_CHUNK * MUSIC_CHANNELS];
+	int16_t *out = (int16_t *)buffer;
+
+	std::lock_guard<std::mutex> g(lock);
+	while (frames) {
+		unsigned n = frames > MUSIC_CHUNK ? MUSIC_CHUNK : frames;
+		memset(mix, 0, sizeof(mix));
+		MixTrack(tracks[0], mix, n);
+		MixTrack(tracks[1], mix, n);
+		for (unsigned i = 0; i < n * MUSIC_CHANNELS; i++)
+			*out++ = (int16_t)(Clamp(mix[i], -1.f, 1.f) * 32767);
+		frames -= n;
+	}
+}
+
+void InitMusic() {
+	stream = LoadAudioStream(MUSIC_RATE, 16, MUSIC_CHANNELS);
+	SetAudioStreamCallback(stream, MusicCallback);
+	PlayAudioStream(stream);
+#ifndef PLATFORM_WEB
+	quit = false;
+	reader = std::thread(Read);
+#endif
+}
+
+// Starts on the reader thread, a moment later.
+void PlayMusic(const char *path, float fade) {
+	{
+		std::lock_guard<std::mutex> g(lock);
+		wanted = path;
+		wantedFade = fade;
+		asked = true;
+	}
+	wake.notify_one();
+}
+
+void StopMusic(float fade) {
+	std::lock_guard<std::mutex> g(lock);
+	asked = false;
+	for (Track &t : tracks) {
+		FadeTo(t, 0, fade);
+		if (t.gain == 0)
+			t.on = false;
+	}
+}
+
+void UnloadMusic() {
+	if (reader.joinable()) {
+		{
+			std::lock_guard<std::mutex> g(lock);
+			quit = true;
+		}
+		wake.notify_one();
+		reader.join();
+	}
+	UnloadAudioStream(stream);
+	for (Track &t : tracks) {
+		t.on = false;
+		CloseWav(t.w);
+	}
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// Music is streamed off disk a chunk at a time by a thread of its own instead
+// of being decoded up front. Tracks loop without a gap, and starting one
+// while another plays crossfades between them over `fade` seconds.
+
+void InitMusic();
+void PlayMusic(const char *path, float fade = 0);
+void StopMusic(float fade = 0);
+void UnloadMusic();
@@ -0,0 +1,168 @@
+#include "global.h"
+#include "mapfile.h"
+#include "pack.h"
+#include <cstdint>
+#include <cstring>
+
+#define PACK_VERSION 1
+#define PACK_ALIGN 16
+
+enum PackKind : uint32_t {
+	PACK_IMAGE,
+	PACK_WAVE
+};
+
+struct PackHeader {
+	char magic[4]; // "BPAK"
+	uint32_t version;
+	uint32_t count;
+	uint32_t pad;
+};
+
+// Images keep width, height, format and mipmaps in a to d; waves keep
+// frame count, sample rate, sample size and channels.
+struct PackEntry {
+	char path[48];
+	uint32_t kind;
+	uint32_t offset; // from the start of the file
+	uint32_t size;
+	uint32_t a;
+	uint32_t b;
+	uint32_t c;
+	uint32_t d;
+};
+
+static const unsigned char *pack = nullptr;
+static size_t packSize = 0;
+static const PackEntry *entries = nullptr;
+static uint32_t entryCount = 0;
+
+bool /* found */ OpenPack(const char *path) {
+	ClosePack();
+	size_t size = 0;
+	const unsigned char *p = (const unsigned char *)MapFile(path, size);
+	if (!p)
+		return false;
+
+	const PackHeader *h = (const PackHeader *)p;
+	bool ok = size >= sizeof(PackHeader) && !memcmp(h->magic, "BPAK", 4) && h->version == PACK_VERSION
+		&& h->count <= (size - sizeof(PackHeader)) / sizeof(PackEntry);
+	const PackEntry *e = (const PackEntry *)(p + sizeof(PackHeader));
+	for (uint32_t i = 0; ok && i < h->count; i++)
+		ok = e[i].offset <= size && e[i].size <= size - e[i].offset && memchr(e[i].path, 0, sizeof(e[i].path));
+	if (!ok) {
+		TraceLog(LOG_WARNING, "PACK: %s is damaged or out of date", path);
+		UnmapFile(p, size);
+		return false;
+	}
+
+	pack = p;
+	packSize = size;
+	entries = e;
+	entryCount = h->count;
+	TraceLog(LOG_INFO, "PACK: Mapped %s, %d files", path, (int)entryCount);
+	return true;
+}
+
+void ClosePack() {
+	UnmapFile(pack, packSize);
+	pack = nullptr;
+	packSize = 0;
+	entries = nullptr;
+	entryCount = 0;
+}
+
+static const PackEntry *Find(const char *path, PackKind kind) {
+	for (uint32_t i = 0; i < entryCount; i++)
+		if (entries[i].kind == kind && !strcmp(entries[i].path, path))
+			return &entries[i];
+	return nullptr;
+}
+
+// The index has to agree with the bytes behind it, or a stale pack would
+// have raylib read past the end of the entry.
+static bool /* ok */ Sized(const PackEntry *e) {
+	if (e->kind == PACK_IMAGE)
+		return e->a >= 1 && e->a <= 16384 && e->b >= 1 && e->b <= 16384 && e->d == 1
+			&& e->size && e->size == (uint32_t)GetPixelDataSize(e->a, e->b, e->c);
+	return e->a >= 1 && (e->c == 8 || e->c == 16 || e->c == 32) && e->d >= 1 && e->d <= 8
+		&& (uint64_t)e->a * e->d * (e->c / 8) == e->size;
+}
+
+static const PackEntry *FindSized(const char *path, PackKind kind) {
+	const PackEntry *e = Find(path, kind);
+	if (e && !Sized(e)) {
+		TraceLog(LOG_WARNING, "PACK: %s doesn't add up, loading it loose", path);
+		return nullptr;
+	}
+	return e;
+}
+
+bool /* found */ PackImage(const char *path, Image &out) {
+	const PackEntry *e = FindSized(path, PACK_IMAGE);
+	if (!e)
+		return false;
+	out.data = (void *)(pack + e->offset);
+	out.width = e->a;
+	out.height = e->b;
+	out.format = e->c;
+	out.mipmaps = e->d;
+	return true;
+}
+
+bool /* found */ PackWave(const char *path, Wave &out) {
+	const PackEntry *e = FindSized(path, PACK_WAVE);
+	if (!e)
+		return false;
+	out.data = (void *)(pack + e->offset);
+	out.frameCount = e->a;
+	out.sampleRate = e->b;
+	out.sampleSize = e->c;
+	out.channels = e->d;
+	return true;
+}
+
+bool /* ok */ WritePack(const char *path, const std::vector<PackItem> &items) {
+	std::vector<unsigned char> out(sizeof(PackHeader) + items.size() * sizeof(PackEntry));
+	std::vector<PackEntry> index(items.size());
+
+	for (size_t i = 0; i < items.size(); i++) {
+		const PackItem &it = items[i];
+		PackEntry &e = index[i];
+		if (strlen(it.path) >= sizeof(e.path)) {
+			TraceLog(LOG_WARNING, "PACK: %s needs a shorter path", it.path);
+			return false;
+		}
+		memcpy(e.path, it.path, strlen(it.path) + 1);
+
+		const void *data;
+		if (it.wave) {
+			e.kind = PACK_WAVE;
+			e.a = it.wav.frameCount;
+			e.b = it.wav.sampleRate;
+			e.c = it.wav.sampleSize;
+			e.d = it.wav.channels;
+			e.size = it.wav.frameCount * it.wav.channels * it.wav.sampleSize / 8;
+			data = it.wav.data;
+		}
+		else {
+			e.kind = PACK_IMAGE;
+			e.a = it.img.width;
+			e.b = it.img.height;
+			e.c = it.img.format;
+			e.d = it.img.mipmaps;
+			e.size = GetPixelDataSize(it.img.width, it.img.height, it.img.format);
+			data = it.img.data;
+		}
+
+		out.resize((out.size() + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN);
+		e.offset = (uint32_t)out.size();
+		out.insert(out.end(), (const unsigned char *)data, (const unsigned char *)data + e.size);
+	}
+
+	PackHeader h{ { 'B', 'P', 'A', 'K' }, PACK_VERSION, (uint32_t)items.size(), 0 };
+	memcpy(out.data(), &h, sizeof(h));
+	if (!index.empty())
+		memcpy(out.data() + sizeof(h), index.data(), index.size() * sizeof(PackEntry));
+	return SaveFileData(path, out.data(), (int)out.size());
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// Every sprite and sound in one file, decoded ahead of time to RGBA pixels
+// and PCM samples behind an index. It's mapped into memory and the images
+// and waves handed out point straight into it, so they're never unloaded
+// and never written to.
+
+#include <vector>
+
+struct PackItem {
+	const char *path;
+	bool wave;
+	Image img;
+	Wave wav;
+};
+
+bool /* found */ OpenPack(const char *path);
+void ClosePack();
+bool /* found */ PackImage(const char *path, Image &out);
+bool /* found */ PackWave(const char *path, Wave &out);
+
+bool /* ok */ WritePack(const char *path, const std::vector<PackItem> &items);
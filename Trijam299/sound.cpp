@@ -1,102 +1,232 @@
 #include "global.h"
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <thread>
 
-static SoundID snd_dont_repeat[] = {
-	SND_PROGRESS,
-	SND_PROGRESS1,
-	SND_DIE,
-	SND_GAME_OVER,
-	SND_MENU1,
-	SND_MUSIC
+#define MAX_VOICES 4 // most copies of one sound playing at once
+#define MIX_VOICES 12 // most sounds playing at once, all told
+#define QUEUE_SIZE 64 // commands in flight; a power of two
+
+struct SoundDef {
+	const char *path;
+	bool once; // don't restart it while it's still playing
+	int voices;
+	int priority; // when the mix is full, lower ones get cut for higher ones
+	float volume;
+};
+
+// In SoundID order.
+static constexpr SoundDef sounds[] = {
+	{ "snd/menu.wav", false, 2, 1, 1 }, // SND_MENU
+	{ "snd/start.wav", false, 1, 3, 1 }, // SND_START
+	{ "snd/die.wav", true, 1, 3, 1 }, // SND_DIE
+	{ "snd/gameover.wav", true, 1, 4, 1 }, // SND_GAME_OVER
+	{ "snd/repair.wav", false, 2, 1, 1 }, // SND_REPAIR
+	{ "snd/combo.wav", false, 2, 2, 1 }, // SND_COMBO
+	{ "snd/progress.wav", true, 1, 2, 1 }, // SND_PROGRESS
+	{ "snd/detection.wav", false, 2, 2, 1 }, // SND_DETECTION
+	{ "snd/explosion.wav", false, 3, 2, 1 }, // SND_EXPLOSION
+	{ "snd/fire.wav", false, 4, 0, 0.2f }, // SND_FIRE
+	{ "snd/win.wav", false, 1, 4, 2 }, // SND_WIN
+};
+
+static_assert(std::size(sounds) == SND_COUNT, "one entry per SoundID");
+
+static constexpr bool /* ok */ CheckSounds() {
+	for (const SoundDef &d : sounds)
+		if (d.voices < 1 || d.voices > MAX_VOICES)
+			return false;
+	return true;
+}
+
+static_assert(CheckSounds(), "every sound needs between 1 and MAX_VOICES voices");
+
+// The file itself, then aliases onto it for the extra voices.
+struct Voices {
+	AssetID v[MAX_VOICES];
+	Sound s[MAX_VOICES]; // what the sound thread plays, so it never looks in the asset list
+	double started[MAX_VOICES];
 };
 
-Sound sndf_menu;
-Sound sndf_start;
-Sound sndf_die;
-Sound sndf_gover;
-Sound sndf_repair;
-Sound sndf_combo;
-Sound sndf_progress;
-Sound sndf_progress1;
-Sound sndf_detection;
-Sound sndf_explosion;
-Sound sndf_fire;
-Sound sndf_menu1;
-Sound sndf_music;
-Sound sndf_win;
+static Voices voices[SND_COUNT];
+
+// Once the sound thread is started, everything that touches a voice runs on
+// it. raylib takes its audio lock for each play, stop and IsSoundPlaying, so
+// the game only drops commands into a ring and never waits on it. raylib's
+// own mixer callback can't drain it itself: it already holds that lock.
+
+enum SoundCmd : uint8_t {
+	CMD_PLAY,
+	CMD_STOP,
+	CMD_QUIT
+};
+
+struct Command {
+	SoundCmd c;
+	uint8_t id;
+};
+
+static Command queue[QUEUE_SIZE];
+static std::atomic<uint32_t> head = 0; // written by the game
+static std::atomic<uint32_t> tail = 0; // written by the sound thread
+static std::thread worker;
+static bool threaded = false;
+
+void QueueSounds() {
+	for (const SoundDef &d : sounds)
+		QueueSound(d.path);
+}
 
 void LoadSounds() {
-	sndf_menu = LoadSound("snd/menu.wav");
-	sndf_start = LoadSound("snd/start.wav");
-	sndf_die = LoadSound("snd/die.wav");
-	sndf_gover = LoadSound("snd/gameover.wav");
-	sndf_repair = LoadSound("snd/repair.wav");
-	sndf_combo = LoadSound("snd/combo.wav");
-	sndf_progress = LoadSound("snd/progress.wav");
-	sndf_progress1 = LoadSoundAlias(sndf_progress);
-	sndf_detection = LoadSound("snd/detection.wav");
-	sndf_explosion = LoadSound("snd/explosion.wav");
-	sndf_fire = LoadSound("snd/fire.wav");
-	sndf_menu1 = LoadSoundAlias(sndf_menu);
-	sndf_music = LoadSound("snd/music.wav");
-	sndf_win = LoadSound("snd/win.wav");
+	for (int i = 0; i < SND_COUNT; i++) {
+		Voices &v = voices[i];
+		v.v[0] = AcquireSound(sounds[i].path);
+		for (int j = 1; j < sounds[i].voices; j++)
+			v.v[j] = AcquireSoundAlias(v.v[0]);
+		for (int j = 0; j < sounds[i].voices; j++) {
+			v.s[j] = AssetSound(v.v[j]);
+			v.started[j] = 0;
+		}
+	}
 }
 
-Sound GetSound(SoundID id) {
-	switch (id) {
-	case SND_MENU:
-		return(sndf_menu);
-		break;
-	case SND_START:
-		return(sndf_start);
-		break;
-	case SND_DIE:
-		return(sndf_die);
-		break;
-	case SND_GAME_OVER:
-		return(sndf_gover);
-		break;
-	case SND_REPAIR:
-		return(sndf_repair);
-		break;
-	case SND_COMBO:
-		return(sndf_combo);
+// Hot reloading swaps the samples out from under the cached copies, so
+// without the thread the asset list is asked every time.
+static Sound Voice(int id, int j) {
+	return threaded ? voices[id].s[j] : AssetSound(voices[id].v[j]);
+}
+
+// Makes room in the mix for something of priority `p`. False if everything
+// playing matters more.
+static bool /* room */ FreeVoice(int p) {
+	int playing = 0;
+	int worst = -1;
+	int worstVoice = 0;
+	for (int i = 0; i < SND_COUNT; i++) {
+		Voices &v = voices[i];
+		for (int j = 0; j < sounds[i].voices; j++) {
+			if (!IsSoundPlaying(Voice(i, j)))
+				continue;
+			playing++;
+			if (sounds[i].priority >= p)
+				continue;
+			if (worst < 0 || sounds[i].priority < sounds[worst].priority
+				|| (sounds[i].priority == sounds[worst].priority && v.started[j] < voices[worst].started[worstVoice])) {
+				worst = i;
+				worstVoice = j;
+			}
+		}
+	}
+	if (playing < MIX_VOICES)
+		return true;
+	if (worst < 0)
+		return false;
+	StopSound(Voice(worst, worstVoice));
+	return true;
+}
+
+static void Play(int id) {
+	const SoundDef &d = sounds[id];
+	Voices &v = voices[id];
+
+	// A free voice, or else the one that's been going longest.
+	int pick = -1;
+	int oldest = 0;
+	for (int j = 0; j < d.voices; j++) {
+		if (!IsSoundPlaying(Voice(id, j))) {
+			if (pick < 0)
+				pick = j;
+		}
+		else if (d.once) {
+			return;
+		}
+		if (v.started[j] < v.started[oldest])
+			oldest = j;
+	}
+
+	if (pick < 0)
+		pick = oldest;
+	else if (!FreeVoice(d.priority))
+		return;
+
+	Sound s = Voice(id, pick);
+	SetSoundVolume(s, d.volume); // hot reloads come back at full volume
+	PlaySound(s);
+	v.started[pick] = GetTime();
+}
+
+static void Run(Command c) {
+	switch (c.c) {
+	case CMD_PLAY:
+		Play(c.id);
 		break;
-	case SND_PROGRESS:
-		return(sndf_progress);
+	case CMD_STOP:
+		for (int j = 0; j < sounds[c.id].voices; j++)
+			StopSound(Voice(c.id, j));
 		break;
-	case SND_PROGRESS1:
-		return(sndf_progress1);
+	case CMD_QUIT:
 		break;
-	case SND_DETECTION:
-		return(sndf_detection);
-	case SND_EXPLOSION:
-		return sndf_explosion;
-	case SND_FIRE:
-		return sndf_fire;
-	case SND_MENU1:
-		return sndf_menu1;
-	case SND_MUSIC:
-		return sndf_music;
-	case SND_WIN:
-		return sndf_win;
 	}
 }
 
-void PlaySound(SoundID id) {
-	bool dontrepeat = false;
-
-	for (int i = 0; i < sizeof(snd_dont_repeat) / sizeof(*snd_dont_repeat); i++) {
-		if (id == snd_dont_repeat[i]) {
-			dontrepeat = true;
-			break;
+// Sleeps until there's something to do.
+static void Drain() {
+	for (;;) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t h = head.load(std::memory_order_acquire);
+		if (t == h) {
+			head.wait(h, std::memory_order_acquire);
+			continue;
 		}
+		Command c = queue[t % QUEUE_SIZE];
+		tail.store(t + 1, std::memory_order_release);
+		if (c.c == CMD_QUIT)
+			return;
+		Run(c);
 	}
+}
 
-	if (dontrepeat && IsSoundPlaying(GetSound(id)))
+static void Send(Command c) {
+	if (!threaded) {
+		Run(c);
 		return;
-	PlaySound(GetSound(id));
+	}
+	uint32_t h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) == QUEUE_SIZE)
+		return; // the sound thread is swamped; losing a sound beats waiting
+	queue[h % QUEUE_SIZE] = c;
+	head.store(h + 1, std::memory_order_release);
+	head.notify_one();
+}
+
+void StartSoundThread() {
+#ifndef PLATFORM_WEB // no threads in the web build
+	if (threaded)
+		return;
+	threaded = true;
+	worker = std::thread(Drain);
+#endif
+}
+
+void StopSoundThread() {
+	if (!threaded)
+		return;
+	// Waits for room: it's only ever done on the way out.
+	while (head.load() - tail.load() == QUEUE_SIZE)
+		std::this_thread::yield();
+	uint32_t h = head.load(std::memory_order_relaxed);
+	queue[h % QUEUE_SIZE] = Command{ .c = CMD_QUIT };
+	head.store(h + 1, std::memory_order_release);
+	head.notify_one();
+	worker.join();
+	threaded = false;
+}
+
+void PlaySound(SoundID id) {
+	Send(Command{ .c = CMD_PLAY, .id = (uint8_t)id });
 }
 
 void StopSound(SoundID id) {
-	StopSound(GetSound(id));
-}
\ No newline at end of file
+	Send(Command{ .c = CMD_STOP, .id = (uint8_t)id });
+}
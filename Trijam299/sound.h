@@ -8,18 +8,20 @@ enum SoundID {
 	SND_REPAIR,
 	SND_COMBO,
 	SND_PROGRESS,
-	SND_PROGRESS1,
 	SND_DETECTION,
 	SND_EXPLOSION,
 	SND_FIRE,
-	SND_MENU1,
-	SND_MUSIC,
 	SND_WIN,
 
 	SND_COUNT
 };
 
+void QueueSounds(); // for LoadQueuedAssets
 void LoadSounds();
-Sound GetSound(SoundID id);
+// Plays and stops go through a queue to a thread of their own, so they
+// never hold up a frame. Not while hot reloading: that frees samples the
+// thread could be playing.
+void StartSoundThread();
+void StopSoundThread();
 void PlaySound(SoundID id);
 void StopSound(SoundID id);
\ No newline at end of file